@@ -0,0 +1,341 @@
+/* BTreeMap.h
+ Árvore-B em memória, derivada do motor do TrabalhoAula8_V1
+ (pageinit, search_node, ins_in_page, split, insert), como mapa ordenado genérico.
+
+ - Key precisa de operator<; Key e Value precisam ser copiáveis e ter construtor
+   padrão (as páginas são construídas vazias, e split usa vetores de trabalho).
+ - Cada página ocupa cerca de NodeBytes bytes (use 64, 128... para casar com linhas
+   de cache, ou 4096 para casar com páginas) e é alinhada a 64 bytes, também antes
+   do C++17 (o arena alinha os blocos ele mesmo, sem depender do new alinhado).
+ - As páginas vêm de um arena: blocos de páginas alocados de uma vez e liberados
+   todos juntos no destrutor. Não há remoção.
+ - BTreeMap_bench.cpp compara o mapa com std::map.
+*/
+#ifndef BTREEMAP_H
+#define BTREEMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <new>
+#include <vector>
+
+template <typename Key, typename Value, size_t NodeBytes = 256>
+class BTreeMap
+{
+public:
+    // Número de chaves que cabem em NodeBytes (no mínimo 3, uma árvore de ordem 4)
+    static const int MAXKEYS =
+        (NodeBytes - 2 * sizeof(void *)) / (sizeof(Key) + sizeof(Value) + sizeof(void *)) >= 3
+            ? (int)((NodeBytes - 2 * sizeof(void *)) / (sizeof(Key) + sizeof(Value) + sizeof(void *)))
+            : 3;
+    static const int MAXDEPTH = 32; // Mais que suficiente: a altura cresce com log(n)
+
+private:
+    struct alignas(64) BTPAGE
+    {
+        int keycount;                // number of keys in page
+        Key key[MAXKEYS];            // the actual keys
+        Value value[MAXKEYS];        // value of each key
+        BTPAGE *child[MAXKEYS + 1];  // ptrs to descendants
+    };
+
+    static const int BLOCK = 64; // Páginas por bloco do arena
+
+    BTPAGE *root;
+    size_t count;
+    std::vector<void *> blocks; // Memória de cada bloco do arena, como veio do operator new
+    BTPAGE *last;               // Páginas do último bloco (alinhadas a 64 bytes)
+    int used;                   // Páginas usadas do último bloco
+
+    // Primeira página de um bloco: o início da memória arredondado para alignof(BTPAGE)
+    static BTPAGE *block_pages(void *memory)
+    {
+        uintptr_t address = (uintptr_t)memory;
+        address = (address + alignof(BTPAGE) - 1) & ~(uintptr_t)(alignof(BTPAGE) - 1);
+        return (BTPAGE *)address;
+    }
+
+    // Entrega uma página nova do arena
+    BTPAGE *getpage()
+    {
+        if (blocks.empty() || used == BLOCK)
+        {
+            void *memory = ::operator new(BLOCK * sizeof(BTPAGE) + alignof(BTPAGE) - 1);
+            blocks.push_back(memory);
+            last = block_pages(memory);
+            for (int i = 0; i < BLOCK; i++)
+                new (&last[i]) BTPAGE;
+            used = 0;
+        }
+        BTPAGE *page = &last[used++];
+        pageinit(page);
+        return page;
+    }
+
+    static void pageinit(BTPAGE *p_page)
+    {
+        p_page->keycount = 0;
+        for (int j = 0; j <= MAXKEYS; j++)
+            p_page->child[j] = NULL;
+    }
+
+    // Posição da primeira chave >= key; retorna 1 se ela é igual a key
+    static int search_node(const Key &key, const BTPAGE *p_page, int *pos)
+    {
+        int lo = 0, hi = p_page->keycount;
+        while (lo < hi)
+        {
+            int mid = (lo + hi) / 2;
+            if (p_page->key[mid] < key)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        *pos = lo;
+        return lo < p_page->keycount && !(key < p_page->key[lo]);
+    }
+
+    static void ins_in_page(const Key &key, const Value &value, BTPAGE *r_child, BTPAGE *p_page)
+    {
+        int j;
+        for (j = p_page->keycount; j > 0 && key < p_page->key[j - 1]; j--)
+        {
+            p_page->key[j] = p_page->key[j - 1];
+            p_page->value[j] = p_page->value[j - 1];
+            p_page->child[j + 1] = p_page->child[j];
+        }
+        p_page->keycount++;
+        p_page->key[j] = key;
+        p_page->value[j] = value;
+        p_page->child[j + 1] = r_child;
+    }
+
+    // Divide a página cheia, promovendo a chave do meio
+    void split(const Key &key, const Value &value, BTPAGE *r_child, BTPAGE *p_oldpage,
+               Key *promo_key, Value *promo_value, BTPAGE **promo_r_child)
+    {
+        Key workkeys[MAXKEYS + 1];
+        Value workvalues[MAXKEYS + 1];
+        BTPAGE *workchil[MAXKEYS + 2];
+        int j;
+
+        for (j = 0; j < MAXKEYS; j++)
+        {
+            workkeys[j] = p_oldpage->key[j];
+            workvalues[j] = p_oldpage->value[j];
+            workchil[j] = p_oldpage->child[j];
+        }
+        workchil[j] = p_oldpage->child[j];
+        for (j = MAXKEYS; j > 0 && key < workkeys[j - 1]; j--)
+        {
+            workkeys[j] = workkeys[j - 1];
+            workvalues[j] = workvalues[j - 1];
+            workchil[j + 1] = workchil[j];
+        }
+        workkeys[j] = key;
+        workvalues[j] = value;
+        workchil[j + 1] = r_child;
+
+        int mid = (MAXKEYS + 1) / 2;
+        BTPAGE *p_newpage = getpage();
+        for (j = 0; j < mid; j++)
+        {
+            p_oldpage->key[j] = workkeys[j];
+            p_oldpage->value[j] = workvalues[j];
+            p_oldpage->child[j] = workchil[j];
+        }
+        p_oldpage->child[mid] = workchil[mid];
+        for (j = mid + 1; j <= MAXKEYS; j++)
+            p_oldpage->child[j] = NULL;
+        p_oldpage->keycount = mid;
+
+        for (j = mid + 1; j <= MAXKEYS; j++)
+        {
+            p_newpage->key[j - mid - 1] = workkeys[j];
+            p_newpage->value[j - mid - 1] = workvalues[j];
+            p_newpage->child[j - mid - 1] = workchil[j];
+        }
+        p_newpage->child[MAXKEYS - mid] = workchil[MAXKEYS + 1];
+        p_newpage->keycount = MAXKEYS - mid;
+
+        *promo_key = workkeys[mid];
+        *promo_value = workvalues[mid];
+        *promo_r_child = p_newpage;
+    }
+
+    // Retorna -1 para chave duplicada, 1 se houve promoção e 0 caso contrário
+    int insert(BTPAGE *page, const Key &key, const Value &value,
+               BTPAGE **promo_r_child, Key *promo_key, Value *promo_value)
+    {
+        if (page == NULL)
+        {
+            *promo_key = key;
+            *promo_value = value;
+            *promo_r_child = NULL;
+            return 1;
+        }
+
+        int pos;
+        if (search_node(key, page, &pos))
+            return -1;
+
+        BTPAGE *p_b_rrn;
+        Key p_b_key;
+        Value p_b_value;
+        int promoted = insert(page->child[pos], key, value, &p_b_rrn, &p_b_key, &p_b_value);
+        if (promoted != 1)
+            return promoted;
+
+        if (page->keycount < MAXKEYS)
+        {
+            ins_in_page(p_b_key, p_b_value, p_b_rrn, page);
+            return 0;
+        }
+        split(p_b_key, p_b_value, p_b_rrn, page, promo_key, promo_value, promo_r_child);
+        return 1;
+    }
+
+public:
+    // Iterador em ordem de chave: pilha com o caminho da raiz até a chave atual.
+    // Nas páginas abaixo do topo, pos é o filho em que se está (a próxima chave
+    // a visitar nelas); no topo, pos é a chave atual.
+    class iterator
+    {
+        friend class BTreeMap;
+        const BTPAGE *node[MAXDEPTH];
+        int pos[MAXDEPTH];
+        int depth; // -1: fim
+
+        void descend(const BTPAGE *page)
+        {
+            while (page)
+            {
+                depth++;
+                node[depth] = page;
+                pos[depth] = 0;
+                page = page->child[0];
+            }
+        }
+
+        // Sobe até uma página que ainda tenha a chave pos a visitar
+        void climb()
+        {
+            while (depth >= 0 && pos[depth] >= node[depth]->keycount)
+                depth--;
+        }
+
+    public:
+        iterator() : depth(-1) {}
+
+        const Key &key() const { return node[depth]->key[pos[depth]]; }
+        const Value &value() const { return node[depth]->value[pos[depth]]; }
+
+        iterator &operator++()
+        {
+            const BTPAGE *page = node[depth];
+            pos[depth]++;
+            if (page->child[0])
+                descend(page->child[pos[depth]]);
+            else
+                climb();
+            return *this;
+        }
+
+        bool operator==(const iterator &other) const
+        {
+            if (depth < 0 || other.depth < 0)
+                return depth < 0 && other.depth < 0;
+            return node[depth] == other.node[other.depth] && pos[depth] == other.pos[other.depth];
+        }
+        bool operator!=(const iterator &other) const { return !(*this == other); }
+    };
+
+    BTreeMap() : root(NULL), count(0), last(NULL), used(0) {}
+
+    ~BTreeMap()
+    {
+        for (size_t i = 0; i < blocks.size(); i++)
+        {
+            BTPAGE *pages = block_pages(blocks[i]);
+            for (int j = 0; j < BLOCK; j++)
+                pages[j].~BTPAGE();
+            ::operator delete(blocks[i]);
+        }
+    }
+
+    BTreeMap(const BTreeMap &) = delete;
+    BTreeMap &operator=(const BTreeMap &) = delete;
+
+    size_t size() const { return count; }
+
+    // Insere key; retorna false se a chave já existia (o valor antigo é mantido)
+    bool insert(const Key &key, const Value &value)
+    {
+        BTPAGE *promo_rrn;
+        Key promo_key;
+        Value promo_value;
+
+        int promoted = insert(root, key, value, &promo_rrn, &promo_key, &promo_value);
+        if (promoted == -1)
+            return false;
+        if (promoted == 1)
+        {
+            // Cria uma nova raiz (create_root)
+            BTPAGE *page = getpage();
+            page->key[0] = promo_key;
+            page->value[0] = promo_value;
+            page->child[0] = root;
+            page->child[1] = promo_rrn;
+            page->keycount = 1;
+            root = page;
+        }
+        count++;
+        return true;
+    }
+
+    // Valor associado a key, ou NULL se a chave não existe
+    Value *find(const Key &key)
+    {
+        BTPAGE *page = root;
+        int pos;
+        while (page)
+        {
+            if (search_node(key, page, &pos))
+                return &page->value[pos];
+            page = page->child[pos];
+        }
+        return NULL;
+    }
+
+    // Primeira chave >= key
+    iterator lower_bound(const Key &key) const
+    {
+        iterator it;
+        const BTPAGE *page = root;
+        while (page && it.depth + 1 < MAXDEPTH)
+        {
+            int pos;
+            int found = search_node(key, page, &pos);
+            it.depth++;
+            it.node[it.depth] = page;
+            it.pos[it.depth] = pos;
+            if (found)
+                return it;
+            page = page->child[pos];
+        }
+        it.climb();
+        return it;
+    }
+
+    iterator begin() const
+    {
+        iterator it;
+        if (root && root->keycount > 0)
+            it.descend(root);
+        return it;
+    }
+
+    iterator end() const { return iterator(); }
+};
+
+#endif
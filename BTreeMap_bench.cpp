@@ -0,0 +1,128 @@
+// Comparação do BTreeMap com std::map: inserção, busca, varredura em ordem e lower_bound
+// com chaves int aleatórias. Também confere se os dois mapas dão o mesmo resultado.
+//
+// Uso: BTreeMap_bench [n] [semente]
+// Compilar: g++ -O2 -o BTreeMap_bench BTreeMap_bench.cpp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+#include <vector>
+#include <chrono>
+#include "BTreeMap.h"
+
+#define BENCH_KEYS 1000000 // Chaves inseridas, se nada for configurado
+
+// Segundos desde start
+double elapsed(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Gerador xorshift: o mesmo n e a mesma semente dão as mesmas chaves em qualquer sistema
+unsigned next_random(unsigned *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+int main(int argc, char *argv[])
+{
+    int n = argc > 1 ? atoi(argv[1]) : BENCH_KEYS;
+    unsigned state = argc > 2 ? (unsigned)atoi(argv[2]) : 2463534242u;
+    if (n <= 0 || state == 0)
+    {
+        printf("Uso: %s [n > 0] [semente != 0]\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<int> keys(n), queries(n);
+    for (int i = 0; i < n; i++)
+        keys[i] = (int)(next_random(&state) % (4u * (unsigned)n));
+    for (int i = 0; i < n; i++)
+        queries[i] = (int)(next_random(&state) % (4u * (unsigned)n));
+
+    BTreeMap<int, int> btree;
+    std::map<int, int> reference;
+    long long btree_sum = 0, map_sum = 0;
+    int errors = 0;
+
+    printf("%d chaves int aleatorias, NodeBytes = 256 (%d chaves por pagina)\n", n, BTreeMap<int, int>::MAXKEYS);
+    printf("%-12s %12s %12s\n", "Operacao", "BTreeMap (s)", "std::map (s)");
+
+    // Inserção (as duplicadas são rejeitadas pelos dois)
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; i++)
+        btree.insert(keys[i], i);
+    double btree_time = elapsed(start);
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; i++)
+        reference.insert(std::make_pair(keys[i], i));
+    double map_time = elapsed(start);
+    printf("%-12s %12.3f %12.3f\n", "insercao", btree_time, map_time);
+    if (btree.size() != reference.size())
+        errors++;
+
+    // Busca (metade das consultas, em média, não existe)
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; i++)
+    {
+        int *value = btree.find(queries[i]);
+        btree_sum += value ? *value : -1;
+    }
+    btree_time = elapsed(start);
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; i++)
+    {
+        std::map<int, int>::iterator found = reference.find(queries[i]);
+        map_sum += found != reference.end() ? found->second : -1;
+    }
+    map_time = elapsed(start);
+    printf("%-12s %12.3f %12.3f\n", "busca", btree_time, map_time);
+    if (btree_sum != map_sum)
+        errors++;
+
+    // Varredura em ordem de chave
+    btree_sum = map_sum = 0;
+    start = std::chrono::steady_clock::now();
+    for (BTreeMap<int, int>::iterator it = btree.begin(); it != btree.end(); ++it)
+        btree_sum = btree_sum * 31 + it.key();
+    btree_time = elapsed(start);
+    start = std::chrono::steady_clock::now();
+    for (std::map<int, int>::iterator it = reference.begin(); it != reference.end(); ++it)
+        map_sum = map_sum * 31 + it->first;
+    map_time = elapsed(start);
+    printf("%-12s %12.3f %12.3f\n", "varredura", btree_time, map_time);
+    if (btree_sum != map_sum)
+        errors++;
+
+    // lower_bound
+    btree_sum = map_sum = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; i++)
+    {
+        BTreeMap<int, int>::iterator it = btree.lower_bound(queries[i]);
+        btree_sum += it != btree.end() ? it.key() : -1;
+    }
+    btree_time = elapsed(start);
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; i++)
+    {
+        std::map<int, int>::iterator it = reference.lower_bound(queries[i]);
+        map_sum += it != reference.end() ? it->first : -1;
+    }
+    map_time = elapsed(start);
+    printf("%-12s %12.3f %12.3f\n", "lower_bound", btree_time, map_time);
+    if (btree_sum != map_sum)
+        errors++;
+
+    if (errors)
+    {
+        printf("BTreeMap e std::map divergiram em %d verificacoes\n", errors);
+        return 1;
+    }
+    printf("BTreeMap e std::map deram os mesmos resultados\n");
+    return 0;
+}
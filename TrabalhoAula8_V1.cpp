@@ -1,9 +1,16 @@
 /* bt.h
  header file for btree programs
 */
+#define _FILE_OFFSET_BITS 64 // off_t de 64 bits em sistemas de 32 bits
 #include <stdio.h>
 #include <stdlib.h>
 
+#ifdef _WIN32
+// No Windows, fseek/ftell usam long de 32 bits; as variantes _i64 usam 64 bits
+#define fseeko _fseeki64
+#define ftello _ftelli64
+#endif
+
 #define MAXKEYS 4
 #define MINKEYS MAXKEYS / 2
 #define NIL (-1)
@@ -15,12 +22,32 @@ typedef struct
 {
     short keycount;           // number of keys in page
     char key[MAXKEYS];        // the actual keys
-    short child[MAXKEYS + 1]; // ptrs to rrns of descendants
+    long long child[MAXKEYS + 1]; // ptrs to rrns of descendants
 } BTPAGE;
 
 #define PAGESIZE sizeof(BTPAGE)
 
-short root; // rrn of root page
+#define BTMAGIC 0x31544241 // "ABT1": identifica um btree.bin com cabeçalho versionado
+#define BTVERSION 2        // 1: formato original, sem cabeçalho, com raiz e filhos em short;
+                           // 2: cabeçalho com magic e versão, raiz e filhos em long long
+
+// Cabeçalho do btree.bin
+typedef struct
+{
+    int magic;      // BTMAGIC
+    int version;    // Versão do formato (BTVERSION)
+    long long root; // rrn of root page
+} BTHEADER;
+
+// Página do formato original (versão 1), convertida na abertura
+typedef struct
+{
+    short keycount;
+    char key[MAXKEYS];
+    short child[MAXKEYS + 1];
+} LEGACYPAGE;
+
+long long root; // rrn of root page
 FILE *btfd; // file descriptor of btree file
 FILE *infd; // file descriptor of input file
 
@@ -28,18 +55,18 @@ FILE *infd; // file descriptor of input file
 /*
 void btclose();
 int btopen();
-int btread(short rrn, BTPAGE *page_ptr);
-int btwrite(short rrn, BTPAGE *page_ptr);
-short create_root(char key, short left, short right);
-short create_tree();
-short getpage();
-short getroot();
-int insert(short rrn, char key, short *promo_r_child, char *promo_key);
-void ins_in_page(char key, short r_child, BTPAGE *p_page);
+int btread(long long rrn, BTPAGE *page_ptr);
+int btwrite(long long rrn, BTPAGE *page_ptr);
+long long create_root(char key, long long left, long long right);
+long long create_tree();
+long long getpage();
+long long getroot();
+int insert(long long rrn, char key, long long *promo_r_child, char *promo_key);
+void ins_in_page(char key, long long r_child, BTPAGE *p_page);
 void pageinit(BTPAGE *p_page);
-void putroot(short root);
+void putroot(long long root);
 int search_node(char key, BTPAGE *p_page, short *pos);
-void split(char key, short r_child, BTPAGE *p_oldpage, char *promo_key, short *promo_r_child, BTPAGE *p_newpage);
+void split(char key, long long r_child, BTPAGE *p_oldpage, char *promo_key, long long *promo_r_child, BTPAGE *p_newpage);
 */
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -52,16 +79,98 @@ void split(char key, short r_child, BTPAGE *p_oldpage, char *promo_key, short *p
 
 //FILE *btfd; // global file descriptor for "btree.dat"
 
-// Função para abrir o arquivo "btree.dat" em modo de leitura/escrita binária
+// Converte um btree.bin do formato original (raiz em short seguida das páginas, sem
+// cabeçalho) para o formato atual, gravando btree.tmp e trocando um pelo outro
+void btmigrate()
+{
+    short old_root;
+    LEGACYPAGE old_page;
+    BTPAGE page;
+    long long pages = 0;
+
+    fseeko(btfd, 0, SEEK_SET);
+    FILE *tmp = fopen("btree.tmp", "wb");
+    if (tmp == NULL || fread(&old_root, sizeof(short), 1, btfd) != 1)
+    {
+        perror("Erro ao converter btree.bin");
+        exit(1);
+    }
+
+    BTHEADER header;
+    header.magic = BTMAGIC;
+    header.version = BTVERSION;
+    header.root = old_root;
+    int ok = fwrite(&header, sizeof(BTHEADER), 1, tmp) == 1;
+    while (ok && fread(&old_page, sizeof(LEGACYPAGE), 1, btfd) == 1)
+    {
+        page.keycount = old_page.keycount;
+        for (int j = 0; j < MAXKEYS; j++)
+            page.key[j] = old_page.key[j];
+        for (int j = 0; j <= MAXKEYS; j++)
+            page.child[j] = old_page.child[j]; // NIL continua -1
+        ok = fwrite(&page, PAGESIZE, 1, tmp) == 1;
+        pages++;
+    }
+    if (fclose(tmp) != 0)
+        ok = 0;
+    fclose(btfd);
+    btfd = NULL;
+
+#ifdef _WIN32
+    if (ok)
+        remove("btree.bin");
+#endif
+    if (!ok || rename("btree.tmp", "btree.bin") != 0)
+    {
+        perror("Erro ao substituir btree.bin");
+        remove("btree.tmp");
+        exit(1);
+    }
+    printf("btree.bin convertido do formato original para a versao %d: %lld paginas\n", BTVERSION, pages);
+    btfd = fopen("btree.bin", "rb+");
+}
+
+// Função para abrir o arquivo "btree.dat" em modo de leitura/escrita binária.
+// Um arquivo do formato original é convertido; outros formatos são recusados.
 int btopen()
 {
     btfd = fopen("btree.bin", "rb+");
-    if (btfd != NULL) {
-        //fclose(btfd);  // Fecha o arquivo, pois só precisamos verificar a abertura
-        return 1;      // Retorna 1 para indicar sucesso
-    } else {
-        return 0;      // Retorna 0 para indicar falha
+    if (btfd == NULL)
+        return 0; // Retorna 0 para indicar falha
+
+    fseeko(btfd, 0, SEEK_END);
+    long long size = ftello(btfd);
+    if (size == 0)
+    {
+        // Arquivo vazio (criação interrompida): é recriado
+        fclose(btfd);
+        btfd = NULL;
+        return 0;
     }
+
+    BTHEADER header;
+    fseeko(btfd, 0, SEEK_SET);
+    if (fread(&header, sizeof(BTHEADER), 1, btfd) == 1 && header.magic == BTMAGIC)
+    {
+        if (header.version != BTVERSION)
+        {
+            printf("btree.bin usa a versao %d do formato; este programa le somente a versao %d.\n", header.version, BTVERSION);
+            exit(1);
+        }
+        return 1; // Retorna 1 para indicar sucesso
+    }
+
+    if (size >= (long long)sizeof(short) && (size - (long long)sizeof(short)) % (long long)sizeof(LEGACYPAGE) == 0)
+    {
+        btmigrate();
+        if (btfd != NULL)
+            return 1;
+        perror("Erro ao reabrir btree.bin");
+        exit(1);
+    }
+
+    printf("btree.bin nao e um arquivo de arvore-B reconhecido; apague-o para criar um novo.\n");
+    exit(1);
 }
 
 // Função para fechar o arquivo
@@ -74,61 +183,69 @@ void btclose()
 }
 
 // Função para obter a raiz da árvore B do arquivo
-short getroot()
+long long getroot()
 {
-    short root;
+    long long root;
 
-    fseek(btfd, 0L, SEEK_SET);
+    BTHEADER header;
 
-    if (fread(&root, sizeof(short), 1, btfd) == 0)
+    fseeko(btfd, 0, SEEK_SET);
+
+    if (fread(&header, sizeof(BTHEADER), 1, btfd) == 0)
     {
         printf("Error: Unable to get root. \007\n");
         exit(1);
     }
+    root = header.root;
     return root;
 }
 
 // Função para atualizar a raiz da árvore B no arquivo
-void putroot(short root)
+void putroot(long long root)
 {
+    BTHEADER header;
+    header.magic = BTMAGIC;
+    header.version = BTVERSION;
+    header.root = root;
+
     // Posiciona o cursor no início do arquivo
-    fseek(btfd, 0L, SEEK_SET);
+    fseeko(btfd, 0, SEEK_SET);
 
-    // Escreve o valor da raiz no arquivo
-    fwrite(&root, sizeof(short), 1, btfd);
+    // Escreve o cabeçalho, com o valor da raiz, no arquivo
+    fwrite(&header, sizeof(BTHEADER), 1, btfd);
 }
 
 // Função para obter a página a partir do arquivo
-short getpage()
+long long getpage()
 {
-    long addr;
+    long long addr;
     // Vai para o final do arquivo e calcula o endereço da página
-    fseek(btfd, 0L, SEEK_END);
-    addr = ftell(btfd) - sizeof(short);
-    return ((short)addr / PAGESIZE);
+    fseeko(btfd, 0, SEEK_END);
+    addr = ftello(btfd) - sizeof(BTHEADER);
+    return (addr / (long long)PAGESIZE);
 }
 
 // Função para ler uma página da árvore B
-int btread(short rrn, BTPAGE *page_ptr)
+int btread(long long rrn, BTPAGE *page_ptr)
 {
-    long addr;
+    long long addr;
 
     // Calcula o endereço da página e posiciona o cursor
-    addr = (long)rrn * (long)PAGESIZE + sizeof(short);
-    fseek(btfd, addr, SEEK_SET);
+    addr = rrn * (long long)PAGESIZE + sizeof(BTHEADER);
+    fseeko(btfd, addr, SEEK_SET);
 
     // Lê a página do arquivo
     return fread(page_ptr, PAGESIZE, 1, btfd) == 1;
 }
 
 // Função para escrever uma página na árvore B
-int btwrite(short rrn, BTPAGE *page_ptr)
+int btwrite(long long rrn, BTPAGE *page_ptr)
 {
-    long addr;
+    long long addr;
 
     // Calcula o endereço da página e posiciona o cursor
-    addr = (long)rrn * (long)PAGESIZE + sizeof(short);
-    fseek(btfd, addr, SEEK_SET);
+    addr = rrn * (long long)PAGESIZE + sizeof(BTHEADER);
+    fseeko(btfd, addr, SEEK_SET);
 
     // Escreve a página no arquivo
     return fwrite(page_ptr, PAGESIZE, 1, btfd) == 1;
@@ -151,10 +268,10 @@ void pageinit(BTPAGE *p_page)
     p_page->child[MAXKEYS] = NIL;
 }
 
-short create_root(char key, short left, short right)
+long long create_root(char key, long long left, long long right)
 {
     BTPAGE page;
-    short rrn;
+    long long rrn;
     rrn = getpage();
     pageinit(&page);
     page.key[0] = key;
@@ -167,7 +284,7 @@ short create_root(char key, short left, short right)
 }
 
 // Função para criar a árvore B
-short create_tree()
+long long create_tree()
 {
     char key;
 
@@ -177,6 +294,7 @@ short create_tree()
         perror("Erro ao criar o arquivo");
         exit(1);
     }
+    putroot(NIL); // Grava o cabeçalho antes da primeira página
     btclose();
     btopen();
     printf("Insira o caracter:");
@@ -204,7 +322,7 @@ int search_node(char key, BTPAGE *p_page, short *pos)
     }
 }
 
-void ins_in_page(char key, short r_child, BTPAGE *p_page)
+void ins_in_page(char key, long long r_child, BTPAGE *p_page)
 {
     int j;
     for (j = p_page->keycount; key < p_page->key[j - 1] && j > 0; j--)
@@ -217,12 +335,12 @@ void ins_in_page(char key, short r_child, BTPAGE *p_page)
     p_page->child[j + 1] = r_child;
 }
 
-void split(char key, short r_child, BTPAGE *p_oldpage, char *promo_key, short *promo_r_child, BTPAGE *p_newpage)
+void split(char key, long long r_child, BTPAGE *p_oldpage, char *promo_key, long long *promo_r_child, BTPAGE *p_newpage)
 {
     int j;
     short mid;
     char workkeys[MAXKEYS + 1];
-    short workchil[MAXKEYS + 2];
+    long long workchil[MAXKEYS + 2];
 
     for (j = 0; j < MAXKEYS; j++)
     {
@@ -266,13 +384,13 @@ void split(char key, short r_child, BTPAGE *p_oldpage, char *promo_key, short *p
  */
 
 // #include "bt.h"
-int insert(short rrn, char key, short *promo_r_child, char *promo_key)
+int insert(long long rrn, char key, long long *promo_r_child, char *promo_key)
 {
     BTPAGE page,         // current page
         newpage;         // new page created if split occurs
     int found, promoted; // boolean values
-    short pos,
-        p_b_rrn;  // rrn promoted from below
+    short pos;
+    long long p_b_rrn; // rrn promoted from below
     char p_b_key; // key promoted from below
 
     if (rrn == NIL)
@@ -322,8 +440,8 @@ If necessary creates new root.
 int main()
 {
     int promoted;   // boolean: tells if a promotion from below
-    short root,     // rrn of root page
-        promo_rrn;  // rrn promoted from below
+    long long root,  // rrn of root page
+        promo_rrn;   // rrn promoted from below
     char promo_key, // key promoted from below
         key;        // next key to insert in tree
 
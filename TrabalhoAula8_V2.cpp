@@ -1,11 +1,44 @@
+#define _FILE_OFFSET_BITS 64 // off_t de 64 bits em sistemas de 32 bits
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <queue>
+#include "BTreeMap.h"
+
+#ifdef _WIN32
+// No Windows, fseek/ftell usam long de 32 bits; as variantes _i64 usam 64 bits
+#define fseeko _fseeki64
+#define ftello _ftelli64
+#include <io.h> // _commit
+#else
+#include <fcntl.h>  // posix_fadvise
+#include <unistd.h> // fsync
+#include <sys/resource.h> // getrlimit
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <nmmintrin.h> // _mm_crc32_*: CRC32C por instrução (SSE4.2)
+#define CRC32C_HARDWARE
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h> // SSE2 (presente em todo x86-64): agregação do arquivo colunar
+#endif
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 #define MAX_INSERE 14
 #define MAX_BUSCA 7
+#define MAX_ATUALIZA 4096 // Atualizações lidas e aplicadas por vez (o arquivo de lote pode ter qualquer tamanho)
+#define UPDATE_FILENAME "atualiza.bin" // Arquivo de atualizações de notas em lote
 
 struct busca
 {
@@ -13,6 +46,15 @@ struct busca
     char sigla_disc[4];
 } vet_b[MAX_BUSCA];
 
+// Registro do arquivo de atualizações (mesmo formato de chave do busca.bin)
+struct atualiza
+{
+    char id_aluno[4];
+    char sigla_disc[4];
+    float media;
+    float frequencia;
+};
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 #define MAX_KEYS 3 // Número máximo de chaves para uma árvore-B de ordem 4
@@ -20,6 +62,16 @@ struct busca
 #define NIL -1
 #define FILENAME "registros.bin"   // Arquivo de dados dos alunos
 #define INDEX_FILENAME "index.bin" // Arquivo de índice
+#define POLICY_SPLIT 0        // Página cheia é sempre dividida ao meio
+#define POLICY_REDISTRIBUTE 1 // Folha cheia repassa chaves a uma irmã; se não der, divisão 2-para-3
+#define COLUMN_FILENAME "colunas.bin"      // Arquivo colunar de médias e frequências
+#define DICTIONARY_FILENAME "disciplinas.bin" // Dicionário código -> nome da disciplina
+#define COMPACT_FILENAME "registros.tmp"   // Arquivo de dados temporário da compactação
+#define COMPACT_INDEX_FILENAME "index.tmp" // Arquivo de índice temporário da compactação
+#define COMPACT_JOURNAL "compactar.jrn"    // Marca de troca confirmada da compactação
+#define VACUUM_FILENAME "index.vac"        // Arquivo de índice temporário do vacuum
+#define MIGRATE_FILENAME "index.mig"       // Arquivo de índice temporário da migração
+#define GRADE_INDEX_FILENAME "index_nota.bin" // Índice secundário por média
 
 // Estrutura para representar o registro de um aluno
 typedef struct
@@ -33,51 +85,245 @@ typedef struct
 } StudentRecord;
 StudentRecord vet[MAX_INSERE];
 
+// Média e frequência do registro, copiadas para junto da chave (índice de cobertura)
+typedef struct
+{
+    float grade;      // Média
+    float attendance; // Frequência
+} KeyFields;
+
 // Estrutura para representar uma página da árvore-B, com endereço do registro
 typedef struct
 {
     int keycount;             // Número de chaves na página
     char keys[MAX_KEYS][7];   // Chaves ("ID+Disciplina")
-    int children[MAX_CHILD];  // Pointers para filhos
-    int record_rrn[MAX_KEYS]; // RRN do registro no arquivo de dados
+    long long children[MAX_CHILD];  // Pointers para filhos
+    long long record_rrn[MAX_KEYS]; // Endereço (em bytes) do registro no arquivo de dados
+    long long child_count[MAX_CHILD]; // Número de chaves na subárvore de cada filho
+    KeyFields fields[MAX_KEYS];       // Média e frequência de cada chave, sem ler o arquivo de dados
+    unsigned int checksum;            // CRC32C dos campos anteriores, conferido a cada leitura
 } BTreePage;
 
+#define INDEX_MAGIC 0x58544241 // "ABTX": identifica um index.bin com cabeçalho versionado
+#define INDEX_VERSION 5        // 2: endereços e números de página de 64 bits; 3: contagem por subárvore;
+                               // 4: média e frequência junto de cada chave; 5: CRC32C por página e no cabeçalho
+
 // Estrutura de cabeçalho para o arquivo de índice
 typedef struct
 {
-    int root_rrn;     // Endereço da raiz da árvore-B
-    int insert_count; // Contador para número de entradas usadas para inserção
-    int search_count; // Contador para número de entradas usadas para busca
+    int magic;          // INDEX_MAGIC
+    int version;        // Versão do formato (INDEX_VERSION)
+    long long root_rrn; // Endereço da raiz da árvore-B
+    int insert_count;   // Contador para número de entradas usadas para inserção
+    int search_count;   // Contador para número de entradas usadas para busca
+    unsigned int checksum; // CRC32C dos campos anteriores
 } Header;
 
+// Cabeçalho do formato original (versão 1), sem identificação e com endereços de 32 bits
+typedef struct
+{
+    int root_rrn;
+    int insert_count;
+    int search_count;
+} LegacyHeader;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// CRC32C (polinômio de Castagnoli) das páginas e do cabeçalho do índice. Em x86 com SSE4.2
+// usa a instrução crc32, 8 bytes por vez; nos demais processadores, uma tabela de 256 entradas.
+// Uma página rasgada por uma gravação interrompida, ou lida pela metade, não confere.
+
+#define CRC32C_POLY 0x82F63B78 // Polinômio refletido
+
+unsigned int crc32c_table[256]; // Tabela do cálculo por software
+
+// Monta a tabela; chamada uma vez, na primeira soma calculada
+int crc32c_init_table()
+{
+    for (unsigned int i = 0; i < 256; i++)
+    {
+        unsigned int crc = i;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (crc & 1 ? CRC32C_POLY : 0);
+        crc32c_table[i] = crc;
+    }
+    return 1;
+}
+
+unsigned int crc32c_software(unsigned int crc, const unsigned char *data, size_t size)
+{
+    static const int ready = crc32c_init_table(); // Inicialização de static local é segura entre threads
+    (void)ready;
+    for (size_t i = 0; i < size; i++)
+        crc = crc32c_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+#ifdef CRC32C_HARDWARE
+// Compilada para SSE4.2 mesmo sem -msse4.2; só é chamada se o processador tiver a instrução
+__attribute__((target("sse4.2"))) unsigned int crc32c_hardware(unsigned int crc, const unsigned char *data, size_t size)
+{
+#ifdef __x86_64__
+    unsigned long long crc64 = crc;
+    for (; size >= 8; size -= 8, data += 8)
+    {
+        unsigned long long word;
+        memcpy(&word, data, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = (unsigned int)crc64;
+#endif
+    for (; size > 0; size--, data++)
+        crc = _mm_crc32_u8(crc, *data);
+    return crc;
+}
+#endif
+
+// CRC32C de size bytes
+unsigned int crc32c(const void *data, size_t size)
+{
+#ifdef CRC32C_HARDWARE
+    static const int hardware = __builtin_cpu_supports("sse4.2");
+    if (hardware)
+        return ~crc32c_hardware(~0u, (const unsigned char *)data, size);
+#endif
+    return ~crc32c_software(~0u, (const unsigned char *)data, size);
+}
+
+// Checksum de uma página: todos os bytes antes do campo checksum
+unsigned int page_checksum(const BTreePage *page)
+{
+    return crc32c(page, offsetof(BTreePage, checksum));
+}
+
+// Checksum do cabeçalho: todos os bytes antes do campo checksum
+unsigned int header_checksum(const Header *header)
+{
+    return crc32c(header, offsetof(Header, checksum));
+}
+
+// Grava o cabeçalho no início de index_file, com o checksum atualizado; retorna 0 se falhou
+int write_header_to(FILE *index_file, Header *header)
+{
+    header->checksum = header_checksum(header);
+    fseeko(index_file, 0, SEEK_SET);
+    return fwrite(header, sizeof(Header), 1, index_file) == 1;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+// Cabeçalhos mantidos em memória, um por arquivo de índice aberto. Buscas e inserções
+// só incrementam os contadores aqui (sob header_lock), sem gravar no arquivo; o cabeçalho
+// vai para o disco quando a raiz muda, a cada HEADER_FLUSH_EVERY operações contadas e
+// quando o arquivo é fechado por close_index_file.
+
+#define HEADER_CACHE_SLOTS 32 // Arquivos de índice abertos ao mesmo tempo (shards, temporários)
+#define HEADER_FLUSH_EVERY 64 // Operações contadas entre gravações do cabeçalho
+
+typedef struct
+{
+    FILE *index_file; // Arquivo dono do cabeçalho (NULL: posição livre)
+    Header header;    // Cópia atual do cabeçalho
+    int pending;      // Operações contadas ainda não gravadas
+} HeaderCache;
+
+HeaderCache header_cache[HEADER_CACHE_SLOTS];
+std::mutex header_lock;
+
+// Cabeçalho de index_file na cache, lido do disco no primeiro acesso (chamar com header_lock)
+HeaderCache *cached_header(FILE *index_file)
+{
+    HeaderCache *free_slot = NULL;
+    for (int i = 0; i < HEADER_CACHE_SLOTS; i++)
+    {
+        if (header_cache[i].index_file == index_file)
+            return &header_cache[i];
+        if (!free_slot && !header_cache[i].index_file)
+            free_slot = &header_cache[i];
+    }
+    if (!free_slot)
+    {
+        printf("Arquivos de índice abertos demais (maximo %d)\n", HEADER_CACHE_SLOTS);
+        exit(1);
+    }
+
+    free_slot->index_file = index_file;
+    memset(&free_slot->header, 0, sizeof(Header));
+    fseeko(index_file, 0, SEEK_SET);
+    fread(&free_slot->header, sizeof(Header), 1, index_file);
+    free_slot->pending = 0;
+    return free_slot;
+}
+
+// Grava no arquivo a cópia em memória do cabeçalho (chamar com header_lock)
+void write_cached_header(HeaderCache *cache)
+{
+    write_header_to(cache->index_file, &cache->header);
+    cache->pending = 0;
+}
+
+// Função para ler o cabeçalho do arquivo de índice
+Header read_header(FILE *index_file)
+{
+    std::lock_guard<std::mutex> guard(header_lock);
+    return cached_header(index_file)->header;
+}
+
+// Função para atualizar o cabeçalho do arquivo de índice (grava na hora)
+void update_header(FILE *index_file, Header *header)
+{
+    std::lock_guard<std::mutex> guard(header_lock);
+    HeaderCache *cache = cached_header(index_file);
+    cache->header = *header;
+    write_cached_header(cache);
+}
+
 // Função para inicializar o cabeçalho do arquivo de índice
 void init_header(FILE *index_file)
 {
     Header header;
+    header.magic = INDEX_MAGIC;
+    header.version = INDEX_VERSION;
     header.root_rrn = NIL;   // Inicialmente, a raiz é NIL (não existe)
     header.insert_count = 0; // Contador de inserções começa em 0
     header.search_count = 0; // Contador de buscas começa em 0
+    update_header(index_file, &header);
+}
 
-    fseek(index_file, 0, SEEK_SET);
-    fwrite(&header, sizeof(Header), 1, index_file);
+// Soma inserções e buscas aos contadores, gravando o cabeçalho só a cada HEADER_FLUSH_EVERY
+void count_operations(FILE *index_file, int inserts, int searches)
+{
+    std::lock_guard<std::mutex> guard(header_lock);
+    HeaderCache *cache = cached_header(index_file);
+    cache->header.insert_count += inserts;
+    cache->header.search_count += searches;
+    if (++cache->pending >= HEADER_FLUSH_EVERY)
+        write_cached_header(cache);
 }
 
-// Função para ler o cabeçalho do arquivo de índice
-Header read_header(FILE *index_file)
+// Grava os contadores pendentes de index_file (ponto de verificação)
+void flush_header(FILE *index_file)
 {
-    Header header;
-    fseek(index_file, 0, SEEK_SET);
-    fread(&header, sizeof(Header), 1, index_file);
-    return header;
+    std::lock_guard<std::mutex> guard(header_lock);
+    for (int i = 0; i < HEADER_CACHE_SLOTS; i++)
+        if (header_cache[i].index_file == index_file && header_cache[i].pending > 0)
+            write_cached_header(&header_cache[i]);
 }
 
-// Função para atualizar o cabeçalho do arquivo de índice
-void update_header(FILE *index_file, Header *header)
+// Grava o cabeçalho pendente, tira index_file da cache e fecha o arquivo
+void close_index_file(FILE *index_file)
 {
-    fseek(index_file, 0, SEEK_SET);
-    fwrite(header, sizeof(Header), 1, index_file);
+    {
+        std::lock_guard<std::mutex> guard(header_lock);
+        for (int i = 0; i < HEADER_CACHE_SLOTS; i++)
+            if (header_cache[i].index_file == index_file)
+            {
+                if (header_cache[i].pending > 0)
+                    write_cached_header(&header_cache[i]);
+                header_cache[i].index_file = NULL;
+            }
+    }
+    fclose(index_file);
 }
 
 // Função para calcular o tamanho do registro
@@ -129,13 +375,14 @@ void initialize_btree(const char *index_filename)
 
         // Inicializa o cabeçalho com raiz NIL e contadores zerados
         Header header;
+        header.magic = INDEX_MAGIC;
+        header.version = INDEX_VERSION;
         header.root_rrn = NIL;   // A árvore começa vazia, sem raiz
         header.insert_count = 0; // Contador de inserções zerado
         header.search_count = 0; // Contador de buscas zerado
 
         // Grava o cabeçalho no início do arquivo de índice
-        fseek(index_file, 0, SEEK_SET);
-        fwrite(&header, sizeof(header), 1, index_file);
+        write_header_to(index_file, &header);
         fflush(index_file);
         printf("Arquivo de índice inicializado com sucesso.\n");
     }
@@ -144,22 +391,117 @@ void initialize_btree(const char *index_filename)
         printf("Arquivo de índice já existe e foi aberto para leitura/escrita.\n");
         Header header;
         header = read_header(index_file);
+        if (header.magic != INDEX_MAGIC || header.version != INDEX_VERSION)
+        {
+            printf("O arquivo %s usa um formato antigo; execute com --migrar.\n", index_filename);
+            exit(1);
+        }
+        if (header.checksum != header_checksum(&header))
+        {
+            printf("O cabecalho de %s esta danificado (checksum); execute com --verificar.\n", index_filename);
+            exit(1);
+        }
         //printf("Root: %d\n", header.root_rrn);
         printf("Insert counter: %d\n", header.insert_count);
         printf("Search counter: %d\n", header.search_count);
     }
 
     // Fecha o arquivo para ser aberto posteriormente em modo "rb+" para operações de leitura/escrita
-    fclose(index_file);
+    close_index_file(index_file);
 }
 
 /////////////////////////////////////////////////////////////////////////////////
 
+// Dicionário de disciplinas: cada código de disciplina aparece uma vez em disciplinas.bin
+// com o seu nome, e os registros gravam só o código (o nome fica vazio). O dicionário
+// inteiro fica em memória, indexado pelo código numérico.
+
+#define MAX_DISCIPLINES 1000 // Códigos de "000" a "999"
+
+// Entrada do arquivo de dicionário
+typedef struct
+{
+    char discipline[4];       // Sigla da disciplina
+    char discipline_name[50]; // Nome da disciplina
+} DictionaryEntry;
+
+FILE *dictfd = NULL;                                 // Arquivo do dicionário (NULL: desativado)
+char discipline_names[MAX_DISCIPLINES][50];          // Nome por código ("" se ausente)
+std::mutex dictionary_lock;                          // Os shards inserem em paralelo
+
+// Código numérico de uma sigla de disciplina, ou -1 se não for de 3 dígitos
+int discipline_code(const char *discipline)
+{
+    for (int i = 0; i < 3; i++)
+        if (discipline[i] < '0' || discipline[i] > '9')
+            return -1;
+    return atoi(discipline);
+}
+
+// Abre (ou cria) o dicionário e carrega todas as entradas em memória
+void load_dictionary()
+{
+    dictfd = fopen(DICTIONARY_FILENAME, "rb+");
+    if (!dictfd)
+        dictfd = fopen(DICTIONARY_FILENAME, "wb+");
+    if (!dictfd)
+        return;
+
+    DictionaryEntry entry;
+    fseeko(dictfd, 0, SEEK_SET);
+    while (fread(&entry, sizeof(DictionaryEntry), 1, dictfd) == 1)
+    {
+        int code = discipline_code(entry.discipline);
+        if (code >= 0)
+            strcpy(discipline_names[code], entry.discipline_name);
+    }
+}
+
+// Garante que a disciplina do aluno está no dicionário. Retorna 1 se o nome pode ser
+// omitido do registro (o dicionário tem exatamente esse nome para o código).
+int dictionary_add(StudentRecord *student)
+{
+    int code = discipline_code(student->discipline);
+    if (!dictfd || code < 0 || student->discipline_name[0] == '\0')
+        return 0;
+
+    std::lock_guard<std::mutex> guard(dictionary_lock);
+    if (discipline_names[code][0] == '\0')
+    {
+        DictionaryEntry entry;
+        memset(&entry, 0, sizeof(DictionaryEntry));
+        strcpy(entry.discipline, student->discipline);
+        memcpy(entry.discipline_name, student->discipline_name, sizeof(entry.discipline_name) - 1);
+        fseeko(dictfd, 0, SEEK_END);
+        fwrite(&entry, sizeof(DictionaryEntry), 1, dictfd);
+        fflush(dictfd);
+        strcpy(discipline_names[code], entry.discipline_name);
+    }
+    return strncmp(discipline_names[code], student->discipline_name, sizeof(student->discipline_name) - 1) == 0;
+}
+
+// Preenche o nome da disciplina a partir do dicionário, se o registro não o trouxe
+void dictionary_lookup(StudentRecord *student)
+{
+    int code = discipline_code(student->discipline);
+    if (student->discipline_name[0] != '\0' || code < 0)
+        return;
+
+    std::lock_guard<std::mutex> guard(dictionary_lock);
+    strcpy(student->discipline_name, discipline_names[code]);
+}
+
 // Função para escrever um registro de aluno no arquivo
-void write_student(FILE *file, StudentRecord *student)
+void write_student(FILE *file, StudentRecord *original)
 {
+    // Com o dicionário, o nome da disciplina não é repetido no registro
+    StudentRecord stored = *original;
+    StudentRecord *student = &stored;
+    if (dictionary_add(original))
+        stored.discipline_name[0] = '\0';
+
     int size = calcularTamanhoRegistro(*student);
-    fseek(file, 0, SEEK_END);
+    fseeko(file, 0, SEEK_END);
     fwrite(&size, sizeof(int), 1, file);
     // Escreve o conteúdo do registro
     fwrite(student->id, sizeof(student->id), 1, file);
@@ -197,7 +539,8 @@ int read_student(FILE *file, StudentRecord *student)
 {
     // Lê o tamanho do registro (número inteiro no início)
     int tamanhoRegistro = 0;
-    fread(&tamanhoRegistro, sizeof(int), 1, file);
+    if (fread(&tamanhoRegistro, sizeof(int), 1, file) != 1)
+        return 0; // Fim do arquivo
 
     // Lê o id_aluno e o delimitador '#'
     char id_aluno[4] = {0};
@@ -241,6 +584,7 @@ int read_student(FILE *file, StudentRecord *student)
     }
     nome_disciplina[i] = '\0';
     strcpy(student->discipline_name, nome_disciplina);
+    dictionary_lookup(student);
 
     // Lê a média e o delimitador '#'
     float media = 0.0;
@@ -252,69 +596,202 @@ int read_student(FILE *file, StudentRecord *student)
     float frequencia = 0.0;
     fread(&frequencia, sizeof(float), 1, file);
     student->attendance = frequencia;
+    return 1;
+}
+
+// Arquivo de índice mantido aberto pelo programa; se for NULL, cada acesso abre o arquivo.
+// É por thread: no modo particionado cada thread trabalha no índice do seu shard.
+thread_local FILE *btfd = NULL;
+
+int cow_mode = 0; // 1: inserções e atualizações usam cópia-na-escrita (ver cow_insert_in_tree)
+
+// Abre o arquivo de índice para acesso a páginas (ou reaproveita o que já está aberto)
+FILE *open_index(const char *mode)
+{
+    if (btfd)
+        return btfd;
+
+    FILE *index_file = fopen(INDEX_FILENAME, mode);
+    if (!index_file)
+    {
+        perror("Erro ao abrir o arquivo de índice");
+        exit(1);
+    }
+    return index_file;
+}
+
+// Fecha o arquivo aberto por open_index, se ele não for o mantido aberto
+void close_index(FILE *index_file)
+{
+    if (index_file != btfd)
+        close_index_file(index_file);
 }
 
 // Função para carregar o RRN da raiz da árvore-B
-int get_root(FILE *index_file)
+long long get_root(FILE *index_file)
 {
-    int root;
-    fseek(index_file, 0, SEEK_SET);
-    fread(&root, sizeof(int), 1, index_file);
-    return root;
+    return read_header(index_file).root_rrn;
 }
 
-// Função para definir o RRN da raiz da árvore-B
-void set_root(int root)
+// Cache de páginas com gravação adiada, ligada durante a fusão da memtable: cada página
+// é lida do disco no máximo uma vez e as alteradas são gravadas uma só vez, em ordem de
+// RRN, em page_cache_end. Páginas novas recebem RRNs além do fim do arquivo.
+// Uma raiz nova também fica só em memória (page_cache_root) e é publicada no cabeçalho
+// depois que as páginas foram gravadas, para o disco nunca apontar para páginas ausentes.
+typedef struct
 {
-    Header header;
-    FILE *index_file = fopen(INDEX_FILENAME, "rb+");
-    read_header(index_file);
-    header.root_rrn = root;
-    fseek(index_file, 0, SEEK_SET);
-    update_header(index_file, &header);
-    //fwrite(&root, sizeof(int), 1, index_file);
+    BTreePage page;
+    int dirty; // 1: alterada desde que foi lida
+} CachedPage;
+
+thread_local BTreeMap<long long, CachedPage> *page_cache = NULL; // NULL: sem cache
+thread_local long long page_cache_next;                           // Próximo RRN livre com a cache ligada
+thread_local long long page_cache_root;                           // Raiz atual, ainda não publicada
+
+// Função para definir o RRN da raiz da árvore-B. Exige btfd: a cache de cabeçalhos é
+// por FILE*, e um arquivo aberto só para esta gravação teria uma cópia própria do
+// cabeçalho, deixando a raiz vista por btfd (e gravada por ele depois) desatualizada.
+void set_root(long long root)
+{
+    if (!btfd)
+    {
+        printf("Erro interno: troca de raiz sem o arquivo de indice aberto (btfd)\n");
+        exit(1);
+    }
+    if (page_cache)
+    {
+        page_cache_root = root; // Publicada por page_cache_end
+        return;
+    }
+    std::lock_guard<std::mutex> guard(header_lock);
+    HeaderCache *cache = cached_header(btfd);
+    cache->header.root_rrn = root;
+    write_cached_header(cache); // Mudança de estrutura: grava na hora, com os contadores
+}
+
+// Guarda page na cache (dirty: página alterada)
+void page_cache_put(long long rrn, BTreePage *page, int dirty)
+{
+    CachedPage *cached = page_cache->find(rrn);
+    if (cached)
+    {
+        cached->page = *page;
+        cached->dirty |= dirty;
+    }
+    else
+    {
+        CachedPage entry = {*page, dirty};
+        page_cache->insert(rrn, entry);
+    }
+}
+
+// Grava uma página, com o checksum atualizado, em um arquivo de índice já aberto;
+// retorna 0 se a gravação falhou
+int write_page_to(FILE *index_file, long long rrn, BTreePage *page)
+{
+    page->checksum = page_checksum(page);
+    fseeko(index_file, sizeof(Header) + rrn * sizeof(BTreePage), SEEK_SET);
+    return fwrite(page, sizeof(BTreePage), 1, index_file) == 1;
 }
 
 // Função para gravar uma página da árvore-B no arquivo de índice
-void write_page(int rrn, BTreePage *page)
+void write_page(long long rrn, BTreePage *page)
 {
-    FILE *index_file = fopen(INDEX_FILENAME, "rb+");
-    if (!index_file)
+    if (page_cache)
     {
-        perror("Erro ao abrir o arquivo de índice");
-        exit(1);
+        page_cache_put(rrn, page, 1);
+        return;
     }
-    fseek(index_file, sizeof(Header) + rrn * sizeof(BTreePage), SEEK_SET);
-    fwrite(page, sizeof(BTreePage), 1, index_file);
-    fclose(index_file);
+
+    FILE *index_file = open_index("rb+");
+    write_page_to(index_file, rrn, page);
+    close_index(index_file);
+}
+
+// Lê uma página de um arquivo de índice já aberto; retorna 0 se a leitura veio
+// incompleta ou o checksum não confere
+int read_page_from(FILE *index_file, long long rrn, BTreePage *page)
+{
+    fseeko(index_file, sizeof(Header) + rrn * sizeof(BTreePage), SEEK_SET);
+    if (fread(page, sizeof(BTreePage), 1, index_file) != 1)
+        return 0;
+    return page->checksum == page_checksum(page);
+}
+
+// Interrompe o programa ao encontrar uma página danificada, em vez de seguir com lixo
+void damaged_page(long long rrn)
+{
+    printf("Pagina %lld do indice danificada (checksum); execute com --verificar.\n", rrn);
+    exit(1);
 }
 
 // Função para ler uma página da árvore-B do arquivo de índice
-void read_page(int rrn, BTreePage *page)
+void read_page(long long rrn, BTreePage *page)
 {
-    FILE *index_file = fopen(INDEX_FILENAME, "rb");
-    if (!index_file)
+    if (page_cache)
     {
-        perror("Erro ao abrir o arquivo de índice");
-        exit(1);
+        CachedPage *cached = page_cache->find(rrn);
+        if (cached)
+        {
+            *page = cached->page;
+            return;
+        }
     }
-    fseek(index_file, sizeof(Header) + rrn * sizeof(BTreePage), SEEK_SET);
-    fread(page, sizeof(BTreePage), 1, index_file);
-    fclose(index_file);
+
+    FILE *index_file = open_index("rb");
+    int intact = read_page_from(index_file, rrn, page);
+    close_index(index_file);
+    if (!intact)
+        damaged_page(rrn);
+    if (page_cache)
+        page_cache_put(rrn, page, 0);
 }
 
-int getpage()
+long long getpage()
 {
-    FILE *index_file = fopen(INDEX_FILENAME, "rb+");
-    if (!index_file)
+    if (page_cache)
+        return page_cache_next++;
+
+    FILE *index_file = open_index("rb+");
+    fseeko(index_file, 0, SEEK_END);
+    long long rrn = (ftello(index_file) - sizeof(Header)) / sizeof(BTreePage);
+    close_index(index_file);
+    return rrn;
+}
+
+// Liga a cache de páginas
+void page_cache_begin()
+{
+    page_cache_next = getpage();
+    page_cache_root = get_root(btfd);
+    page_cache = new BTreeMap<long long, CachedPage>();
+}
+
+// Grava as páginas alteradas em ordem de RRN e desliga a cache; só então publica a raiz
+// nova no cabeçalho. Retorna quantas páginas foram gravadas
+long long page_cache_end()
+{
+    BTreeMap<long long, CachedPage> *cache = page_cache;
+    page_cache = NULL;
+
+    long long written = 0;
+    for (BTreeMap<long long, CachedPage>::iterator it = cache->begin(); it != cache->end(); ++it)
     {
-        perror("Erro ao abrir o arquivo de índice");
-        exit(1);
+        if (!it.value().dirty)
+            continue;
+        BTreePage page = it.value().page;
+        write_page(it.key(), &page);
+        written++;
     }
-    fseek(index_file, 0, SEEK_END);
-    int rrn = (ftell(index_file) - sizeof(Header)) / sizeof(BTreePage);
-    fclose(index_file);
-    return rrn;
+    delete cache;
+
+    fflush(btfd);
+    if (page_cache_root != get_root(btfd))
+    {
+        set_root(page_cache_root);
+        fflush(btfd);
+    }
+    return written;
 }
 
 // Inicializa uma página da árvore-B
@@ -328,20 +805,45 @@ void init_page(BTreePage *page)
         page->children[i] = NIL;
     }
     page->children[MAX_KEYS] = NIL;
+    memset(page->child_count, 0, sizeof(page->child_count));
+    memset(page->fields, 0, sizeof(page->fields));
+}
+
+// Número de chaves da subárvore com raiz em page
+long long subtree_count(BTreePage *page)
+{
+    long long count = page->keycount;
+    for (int i = 0; i <= page->keycount; i++)
+        count += page->child_count[i];
+    return count;
+}
+
+// Número de chaves da subárvore em rrn (lê a página)
+long long subtree_count_at(long long rrn)
+{
+    if (rrn == NIL)
+        return 0;
+    BTreePage page;
+    read_page(rrn, &page);
+    return subtree_count(&page);
 }
 
 // Função para criar uma nova raiz na árvore-B
-int create_root(char *key, int left_child, int right_child)
+long long create_root(char *key, long long record_rrn, KeyFields fields, long long left_child, long long right_child)
 {
     BTreePage new_root;
     init_page(&new_root);
 
     strcpy(new_root.keys[0], key);
+    new_root.record_rrn[0] = record_rrn;
+    new_root.fields[0] = fields;
     new_root.children[0] = left_child;
     new_root.children[1] = right_child;
+    new_root.child_count[0] = subtree_count_at(left_child);
+    new_root.child_count[1] = subtree_count_at(right_child);
     new_root.keycount = 1;
 
-    int rrn = getpage();
+    long long rrn = getpage();
     write_page(rrn, &new_root);
     set_root(rrn);
     return rrn;
@@ -350,7 +852,8 @@ int create_root(char *key, int left_child, int right_child)
 ///////////////////////////////////////////////////////////////////////////////////
 
 // Insere uma chave em uma página da árvore-B
-void insert_in_page(char *key, int record_rrn, int right_child, BTreePage *page)
+// (right_count: número de chaves da subárvore right_child)
+void insert_in_page(char *key, long long record_rrn, KeyFields fields, long long right_child, long long right_count, BTreePage *page)
 {
     //printf("Entrou no insert in page. \n");
     int j;
@@ -358,12 +861,16 @@ void insert_in_page(char *key, int record_rrn, int right_child, BTreePage *page)
     {
         strcpy(page->keys[j + 1], page->keys[j]);
         page->children[j + 2] = page->children[j + 1];
+        page->child_count[j + 2] = page->child_count[j + 1];
         page->record_rrn[j + 1] = page->record_rrn[j];
+        page->fields[j + 1] = page->fields[j];
     }
     //printf("Passou do for de comparacoes do insert in page. \n");
     strcpy(page->keys[j + 1], key);
     page->record_rrn[j + 1] = record_rrn;
+    page->fields[j + 1] = fields;
     page->children[j + 2] = right_child;
+    page->child_count[j + 2] = right_count;
     page->keycount++;
 }
 
@@ -376,7 +883,7 @@ int search_node(char *key, BTreePage *page, int *pos)
 }
 
 // Função de busca na árvore-B
-int search_in_tree(int rrn, char *key, int *page_rrn, int *pos, int *record_rrn)
+int search_in_tree(long long rrn, char *key, long long *page_rrn, int *pos, long long *record_rrn)
 {
     if (rrn == NIL)
         return 0;
@@ -412,7 +919,76 @@ int find_student(FILE *data_file, char *key, StudentRecord *student)
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void list_all_students(FILE *data_file, int rrn)
+// Leitura antecipada da listagem em ordem: ao abrir uma página, pede ao sistema as
+// páginas filhas e os registros dela (em ordem de endereço) antes de usá-los.
+// Para o arquivo de dados há uma janela enquanto os registros lidos caem dentro do
+// trecho já pedido (arquivo compactado, em ordem de chave): a cada renovação ela é
+// medida pela taxa de leitura desde a renovação anterior, para cobrir PREFETCH_LEAD
+// segundos de leitura. Ela volta ao mínimo quando a leitura salta para outro ponto.
+
+#define PREFETCH_MIN 4096      // Janela inicial de leitura antecipada (bytes)
+#define PREFETCH_MAX (1 << 20) // Janela máxima de leitura antecipada (bytes)
+#define PREFETCH_LEAD 0.05     // Segundos de leitura que a janela deve cobrir
+#define PREFETCH_RECORD (long long)(sizeof(int) + sizeof(StudentRecord)) // Maior tamanho de um registro
+
+typedef struct
+{
+    long long window; // Tamanho da janela atual
+    long long start;  // Início do trecho do arquivo de dados já pedido
+    long long end;    // Fim do trecho já pedido
+    long long mark;   // Endereço lido na última renovação da janela
+    std::chrono::steady_clock::time_point mark_time; // Momento da última renovação
+} ScanPrefetch;
+
+// Pede ao sistema que comece a ler [offset, offset + length) de file
+void prefetch(FILE *file, long long offset, long long length)
+{
+#ifdef POSIX_FADV_WILLNEED
+    posix_fadvise(fileno(file), offset, length, POSIX_FADV_WILLNEED);
+#endif
+}
+
+// Lê o registro em record_rrn, ajustando a janela de leitura antecipada
+int scan_record(FILE *data_file, long long record_rrn, ScanPrefetch *ahead, StudentRecord *student)
+{
+    if (record_rrn >= ahead->start && record_rrn < ahead->end)
+    {
+        // Dentro do trecho pedido: a leitura é sequencial. Na metade final do trecho, a
+        // janela passa a ser o que se lê em PREFETCH_LEAD segundos no ritmo medido
+        if (record_rrn + ahead->window / 2 >= ahead->end)
+        {
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            double seconds = std::chrono::duration<double>(now - ahead->mark_time).count();
+            if (seconds > 0 && record_rrn > ahead->mark)
+            {
+                double wanted = (record_rrn - ahead->mark) / seconds * PREFETCH_LEAD;
+                ahead->window = wanted < PREFETCH_MIN ? PREFETCH_MIN
+                              : wanted > PREFETCH_MAX ? PREFETCH_MAX
+                                                      : (long long)wanted;
+            }
+            ahead->mark = record_rrn;
+            ahead->mark_time = now;
+            if (record_rrn + ahead->window > ahead->end)
+            {
+                prefetch(data_file, ahead->end, record_rrn + ahead->window - ahead->end);
+                ahead->end = record_rrn + ahead->window;
+            }
+        }
+    }
+    else
+    {
+        ahead->window = PREFETCH_MIN;
+        ahead->start = ahead->mark = record_rrn;
+        ahead->end = record_rrn + ahead->window;
+        ahead->mark_time = std::chrono::steady_clock::now();
+        prefetch(data_file, record_rrn, ahead->window);
+    }
+
+    fseeko(data_file, record_rrn, SEEK_SET);
+    return read_student(data_file, student);
+}
+
+void list_page(FILE *data_file, long long rrn, ScanPrefetch *ahead)
 {
     if (rrn == NIL)
         return;
@@ -420,228 +996,3809 @@ void list_all_students(FILE *data_file, int rrn)
     BTreePage page;
     read_page(rrn, &page);
 
+    // Páginas filhas: serão lidas logo em seguida pela recursão
+    if (btfd)
+        for (int i = 0; i <= page.keycount; i++)
+            if (page.children[i] != NIL)
+                prefetch(btfd, sizeof(Header) + page.children[i] * sizeof(BTreePage), sizeof(BTreePage));
+
+    // Registros da página fora do trecho já pedido, em ordem crescente de endereço
+    long long offsets[MAX_KEYS];
+    int count = 0;
     for (int i = 0; i < page.keycount; i++)
     {
-        list_all_students(data_file, page.children[i]);
+        int j;
+        for (j = count; j > 0 && offsets[j - 1] > page.record_rrn[i]; j--)
+            offsets[j] = offsets[j - 1];
+        offsets[j] = page.record_rrn[i];
+        count++;
+    }
+    for (int i = 0; i < count; i++)
+        if (offsets[i] < ahead->start || offsets[i] >= ahead->end)
+            prefetch(data_file, offsets[i], PREFETCH_RECORD);
+
+    for (int i = 0; i < page.keycount; i++)
+    {
+        list_page(data_file, page.children[i], ahead);
 
         StudentRecord student;
-        if (find_student(data_file, page.keys[i], &student))
+        if (scan_record(data_file, page.record_rrn[i], ahead, &student))
         {
             printf("ID: %s, Disciplina: %s, Nome: %s, Média: %.2f, Frequência: %.2f\n",
                    student.id, student.discipline, student.name, student.grade, student.attendance);
         }
     }
-    list_all_students(data_file, page.children[page.keycount]);
+    list_page(data_file, page.children[page.keycount], ahead);
 }
 
-////////////////////////////////////////////////////////////////////////////////////////////////////////////
-
-void search_student(FILE *data_file, FILE *index_file, char *key)
+// Lista todos os registros em ordem de chave, lendo cada um direto pelo endereço do índice
+void list_all_students(FILE *data_file, long long rrn)
 {
-    Header header = read_header(index_file);
-
-    int root = header.root_rrn;
-    int page_rrn, pos, record_rrn;
+    ScanPrefetch ahead = {PREFETCH_MIN, 0, 0, 0, std::chrono::steady_clock::now()};
+    list_page(data_file, rrn, &ahead);
+}
 
-    if (search_in_tree(root, key, &page_rrn, &pos, &record_rrn))
-    {
-        printf("Chave %s encontrada, página %d, posição %d\n", key, page_rrn, pos);
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-        fseek(data_file, record_rrn * sizeof(StudentRecord), SEEK_SET);
-        StudentRecord student;
-        fread(&student, sizeof(StudentRecord), 1, data_file);
+// Estatísticas de ordem: cada página guarda quantas chaves há na subárvore de cada
+// filho, então posição de uma chave, contagem de um intervalo e acesso pela posição
+// custam uma descida da raiz, sem percorrer os registros anteriores.
 
-        printf("ID: %s, Disciplina: %s, Nome: %s, Média: %.2f, Frequência: %.2f\n",
-               student.id, student.discipline, student.name, student.grade, student.attendance);
-    }
-    else
+// Número de chaves menores que key; found recebe 1 se key está na árvore
+long long rank_key(long long rrn, char *key, int *found)
+{
+    long long rank = 0;
+    *found = 0;
+    while (rrn != NIL)
     {
-        printf("Chave %s não encontrada\n", key);
+        BTreePage page;
+        int pos;
+        read_page(rrn, &page);
+        int match = search_node(key, &page, &pos);
+        for (int i = 0; i < pos; i++)
+            rank += page.child_count[i] + 1;
+        if (match)
+        {
+            *found = 1;
+            return rank + page.child_count[pos];
+        }
+        rrn = page.children[pos];
     }
-
-    header.search_count++;              // Atualiza o contador de buscas
-    update_header(index_file, &header); // Grava o cabeçalho atualizado no arquivo
+    return rank;
 }
 
-///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-
-void split(char *key, int r_child, int rrn, BTreePage *p_oldpage, char *promo_key, int *promo_r_child, BTreePage *p_newpage, int *promo_rrn)
+// Número de chaves em [lo, hi]
+long long count_keys(long long root, char *lo, char *hi)
 {
-    int mid = 2;
-    char temp_keys[MAX_KEYS + 1][7];
-    int temp_children[MAX_CHILD + 1];
-    int temp_rrns[MAX_KEYS + 1];
+    int found;
+    long long first = rank_key(root, lo, &found);
+    long long last = rank_key(root, hi, &found) + found;
+    return last > first ? last - first : 0;
+}
 
-    for (int i = 0; i < MAX_KEYS; i++)
+// Chave na posição index da ordem (0 é a menor); retorna 0 se não há tantas chaves
+int select_key(long long rrn, long long index, char *key, long long *record_rrn)
+{
+    while (rrn != NIL && index >= 0)
     {
-        strcpy(temp_keys[i], p_oldpage->keys[i]);
-        temp_children[i] = p_oldpage->children[i];
+        BTreePage page;
+        read_page(rrn, &page);
+
+        int i;
+        for (i = 0; i < page.keycount && index >= page.child_count[i]; i++)
+        {
+            index -= page.child_count[i];
+            if (index == 0)
+            {
+                strcpy(key, page.keys[i]);
+                *record_rrn = page.record_rrn[i];
+                return 1;
+            }
+            index--;
+        }
+        rrn = page.children[i];
+    }
+    return 0;
+}
+
+// Mostra *remaining registros a partir da posição *skip, pulando subárvores inteiras
+void list_positions(FILE *data_file, long long rrn, long long *skip, long long *remaining)
+{
+    if (rrn == NIL)
+        return;
+
+    BTreePage page;
+    read_page(rrn, &page);
+    for (int i = 0; i <= page.keycount && *remaining > 0; i++)
+    {
+        if (*skip >= page.child_count[i])
+            *skip -= page.child_count[i];
+        else
+            list_positions(data_file, page.children[i], skip, remaining);
+
+        if (i == page.keycount || *remaining == 0)
+            break;
+        if (*skip > 0)
+        {
+            (*skip)--;
+            continue;
+        }
+
+        StudentRecord student;
+        fseeko(data_file, page.record_rrn[i], SEEK_SET);
+        if (read_student(data_file, &student))
+            printf("ID: %s, Disciplina: %s, Nome: %s, Média: %.2f, Frequência: %.2f\n",
+                   student.id, student.discipline, student.name, student.grade, student.attendance);
+        (*remaining)--;
+    }
+}
+
+// Mostra a página page_number (a partir de 1) da listagem em ordem de chave
+void list_students_page(FILE *data_file, long long root, long long page_number, long long page_size)
+{
+    long long skip = (page_number - 1) * page_size;
+    long long remaining = page_size;
+    list_positions(data_file, root, &skip, &remaining);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void search_student(FILE *data_file, FILE *index_file, char *key)
+{
+    Header header = read_header(index_file);
+
+    long long root = header.root_rrn;
+    long long page_rrn, record_rrn;
+    int pos;
+
+    if (search_in_tree(root, key, &page_rrn, &pos, &record_rrn))
+    {
+        printf("Chave %s encontrada, página %lld, posição %d\n", key, page_rrn, pos);
+
+        fseeko(data_file, record_rrn, SEEK_SET);
+        StudentRecord student;
+        read_student(data_file, &student);
+
+        printf("ID: %s, Disciplina: %s, Nome: %s, Média: %.2f, Frequência: %.2f\n",
+               student.id, student.discipline, student.name, student.grade, student.attendance);
+    }
+    else
+    {
+        printf("Chave %s não encontrada\n", key);
+    }
+
+    count_operations(index_file, 0, 1); // Conta a busca; a busca não grava no arquivo
+}
+
+// Busca key e copia a média e a frequência guardadas junto da chave no índice,
+// sem a segunda leitura (aleatória) no arquivo de dados
+int search_key_fields(long long rrn, char *key, KeyFields *fields)
+{
+    BTreePage page;
+    int pos;
+    while (rrn != NIL)
+    {
+        read_page(rrn, &page);
+        if (search_node(key, &page, &pos))
+        {
+            *fields = page.fields[pos];
+            return 1;
+        }
+        rrn = page.children[pos];
+    }
+    return 0;
+}
+
+// Atualiza a cópia de média e frequência da chave na posição pos da página page_rrn.
+// A página é alterada no lugar; no modo cópia-na-escrita use cow_update_fields.
+void update_key_fields(long long page_rrn, int pos, float grade, float attendance)
+{
+    BTreePage page;
+    read_page(page_rrn, &page);
+    page.fields[pos].grade = grade;
+    page.fields[pos].attendance = attendance;
+    write_page(page_rrn, &page);
+}
+
+// Atualização no modo cópia-na-escrita: grava versões novas das páginas do caminho até
+// a chave, a última com os campos novos, como cow_insert_in_tree. new_rrn recebe a nova
+// versão da página rrn; a raiz nova só vale depois de publicada com set_root. Só as
+// páginas são copiadas: o registro no arquivo de dados é regravado no lugar.
+// Retorna 0 (sem gravar nada) se a chave não está na árvore.
+int cow_update_fields(long long rrn, char *key, KeyFields fields, long long *new_rrn)
+{
+    if (rrn == NIL)
+        return 0;
+
+    BTreePage page;
+    int pos;
+    read_page(rrn, &page);
+    if (search_node(key, &page, &pos))
+        page.fields[pos] = fields;
+    else if (!cow_update_fields(page.children[pos], key, fields, &page.children[pos]))
+        return 0;
+
+    *new_rrn = getpage();
+    write_page(*new_rrn, &page);
+    return 1;
+}
+
+// Publica a raiz nova de atualizações em cópia-na-escrita, depois das páginas no disco
+void cow_publish_root(FILE *index_file, long long old_root, long long new_root)
+{
+    if (new_root == old_root)
+        return;
+    fflush(index_file);
+    set_root(new_root);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+// Arquivo colunar: cópia compacta de média, frequência e código da disciplina de cada
+// registro, para relatórios que não precisam decodificar o arquivo de dados.
+// O arquivo é dividido em blocos de COLUMN_BLOCK linhas; em cada bloco cada campo
+// fica num vetor contíguo. As linhas seguem a ordem do arquivo de dados, então o
+// vetor de endereços é crescente e serve para localizar a linha de um registro.
+
+#define COLUMN_BLOCK 1024 // Linhas por bloco do arquivo colunar
+
+typedef struct
+{
+    int count;                       // Linhas usadas no bloco
+    float grade[COLUMN_BLOCK];       // Médias
+    float attendance[COLUMN_BLOCK];  // Frequências
+    int discipline[COLUMN_BLOCK];    // Código numérico da disciplina
+    long long record_rrn[COLUMN_BLOCK]; // Endereço do registro no arquivo de dados
+} ColumnBlock;
+
+// Resultado de uma agregação sobre o arquivo colunar
+typedef struct
+{
+    int count;        // Linhas selecionadas
+    float sum;        // Soma das médias
+    float min;        // Menor média
+    float max;        // Maior média
+    int below;        // Linhas com frequência abaixo do mínimo pedido
+} ColumnStats;
+
+thread_local FILE *colfd = NULL; // Arquivo colunar mantido aberto (NULL: recurso desativado)
+
+// Lê o bloco de número block do arquivo colunar
+int read_column_block(int block, ColumnBlock *column_block)
+{
+    fseeko(colfd, (long long)block * sizeof(ColumnBlock), SEEK_SET);
+    return fread(column_block, sizeof(ColumnBlock), 1, colfd) == 1;
+}
+
+// Grava o bloco de número block do arquivo colunar
+void write_column_block(int block, ColumnBlock *column_block)
+{
+    fseeko(colfd, (long long)block * sizeof(ColumnBlock), SEEK_SET);
+    fwrite(column_block, sizeof(ColumnBlock), 1, colfd);
+}
+
+// Número de linhas do arquivo colunar
+int column_rows()
+{
+    fseeko(colfd, 0, SEEK_END);
+    int blocks = (int)(ftello(colfd) / sizeof(ColumnBlock));
+    if (blocks == 0)
+        return 0;
+
+    int count;
+    fseeko(colfd, (long long)(blocks - 1) * sizeof(ColumnBlock), SEEK_SET);
+    fread(&count, sizeof(int), 1, colfd);
+    return (blocks - 1) * COLUMN_BLOCK + count;
+}
+
+// Grava um campo da linha pos do bloco que começa em base
+void write_column_field(long long base, size_t field, int pos, const void *value, size_t size)
+{
+    fseeko(colfd, base + field + pos * size, SEEK_SET);
+    fwrite(value, size, 1, colfd);
+}
+
+// Acrescenta a linha de um registro recém-gravado no arquivo de dados. Só os campos da
+// linha nova e a contagem do bloco são gravados; o bloco inteiro (zerado) é gravado
+// uma vez, ao ser aberto, para o arquivo ter sempre um número inteiro de blocos.
+void column_append(long long record_rrn, StudentRecord *student)
+{
+    if (!colfd)
+        return;
+
+    int rows = column_rows();
+    int block = rows / COLUMN_BLOCK;
+    int pos = rows % COLUMN_BLOCK;
+    long long base = (long long)block * sizeof(ColumnBlock);
+
+    if (pos == 0)
+    {
+        static ColumnBlock empty; // Bloco zerado, fora da pilha
+        write_column_block(block, &empty);
+    }
+
+    int discipline = discipline_code(student->discipline);
+    int count = pos + 1;
+    write_column_field(base, offsetof(ColumnBlock, grade), pos, &student->grade, sizeof(float));
+    write_column_field(base, offsetof(ColumnBlock, attendance), pos, &student->attendance, sizeof(float));
+    write_column_field(base, offsetof(ColumnBlock, discipline), pos, &discipline, sizeof(int));
+    write_column_field(base, offsetof(ColumnBlock, record_rrn), pos, &record_rrn, sizeof(long long));
+    write_column_field(base, offsetof(ColumnBlock, count), 0, &count, sizeof(int));
+    fflush(colfd);
+}
+
+// Atualiza média e frequência da linha do registro em record_rrn (busca binária pelo endereço)
+void column_update(long long record_rrn, float grade, float attendance)
+{
+    if (!colfd)
+        return;
+
+    int lo = 0, hi = column_rows() - 1;
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        long long rrn;
+        fseeko(colfd, (long long)(mid / COLUMN_BLOCK) * sizeof(ColumnBlock) + offsetof(ColumnBlock, record_rrn) + (mid % COLUMN_BLOCK) * sizeof(long long), SEEK_SET);
+        fread(&rrn, sizeof(long long), 1, colfd);
+
+        if (rrn < record_rrn)
+            lo = mid + 1;
+        else if (rrn > record_rrn)
+            hi = mid - 1;
+        else
+        {
+            long long base = (long long)(mid / COLUMN_BLOCK) * sizeof(ColumnBlock);
+            int pos = mid % COLUMN_BLOCK;
+            fseeko(colfd, base + offsetof(ColumnBlock, grade) + pos * sizeof(float), SEEK_SET);
+            fwrite(&grade, sizeof(float), 1, colfd);
+            fseeko(colfd, base + offsetof(ColumnBlock, attendance) + pos * sizeof(float), SEEK_SET);
+            fwrite(&attendance, sizeof(float), 1, colfd);
+            fflush(colfd);
+            return;
+        }
+    }
+}
+
+// Reconstrói o arquivo colunar lendo o arquivo de dados do início ao fim
+void column_rebuild(FILE *data_file)
+{
+    if (!colfd)
+        return;
+
+    ColumnBlock column_block;
+    StudentRecord student;
+    int block = 0;
+
+    memset(&column_block, 0, sizeof(ColumnBlock));
+    rewind(data_file);
+    long long record_rrn = ftello(data_file);
+    while (read_student(data_file, &student))
+    {
+        int pos = column_block.count;
+        column_block.grade[pos] = student.grade;
+        column_block.attendance[pos] = student.attendance;
+        column_block.discipline[pos] = discipline_code(student.discipline);
+        column_block.record_rrn[pos] = record_rrn;
+        column_block.count++;
+
+        if (column_block.count == COLUMN_BLOCK)
+        {
+            write_column_block(block++, &column_block);
+            memset(&column_block, 0, sizeof(ColumnBlock));
+        }
+        record_rrn = ftello(data_file);
+    }
+    if (column_block.count > 0)
+        write_column_block(block++, &column_block);
+    fflush(colfd);
+
+    // Descarta blocos que sobraram de um arquivo maior
+    fclose(colfd);
+    FILE *old = fopen(COLUMN_FILENAME, "rb");
+    FILE *tmp = fopen(COLUMN_FILENAME ".tmp", "wb");
+    if (!old || !tmp)
+    {
+        perror("Erro ao recortar o arquivo colunar");
+        exit(1);
+    }
+    int copied = 0;
+    while (copied < block && fread(&column_block, sizeof(ColumnBlock), 1, old) == 1 &&
+           fwrite(&column_block, sizeof(ColumnBlock), 1, tmp) == 1)
+        copied++;
+    fclose(old);
+    if (fclose(tmp) != 0 || copied < block)
+    {
+        perror("Erro ao gravar o arquivo colunar recortado");
+        remove(COLUMN_FILENAME ".tmp");
+        exit(1);
+    }
+#ifdef _WIN32
+    remove(COLUMN_FILENAME);
+#endif
+    if (rename(COLUMN_FILENAME ".tmp", COLUMN_FILENAME) != 0)
+    {
+        perror("Erro ao substituir o arquivo colunar");
+        exit(1);
+    }
+    colfd = fopen(COLUMN_FILENAME, "rb+");
+    if (!colfd)
+    {
+        perror("Erro ao reabrir o arquivo colunar");
+        exit(1);
+    }
+}
+
+// Agrega as linhas [first, n) de um bloco sem desvios: a seleção vira máscara (0 ou 1)
+// e os mínimos/máximos usam o valor neutro nas linhas não selecionadas
+void column_aggregate_scalar(const ColumnBlock *column_block, int first, int n, int discipline,
+                             float min_attendance, ColumnStats *stats)
+{
+    for (int i = first; i < n; i++)
+    {
+        int selected = (discipline < 0) | (column_block->discipline[i] == discipline);
+        float g = column_block->grade[i];
+        float low = selected ? g : 1e30f;
+        float high = selected ? g : -1e30f;
+        stats->count += selected;
+        stats->sum += selected * g;
+        stats->min = low < stats->min ? low : stats->min;
+        stats->max = high > stats->max ? high : stats->max;
+        stats->below += selected & (column_block->attendance[i] < min_attendance);
+    }
+}
+
+// Agrega as linhas de um bloco em stats. Com SSE2, quatro linhas por instrução: a
+// comparação da disciplina gera a máscara que zera as médias não selecionadas na soma
+// e as troca pelo valor neutro no mínimo e no máximo; as contagens somam as máscaras.
+// As linhas que sobram (menos de quatro) e os processadores sem SSE2 usam o laço escalar.
+// (Sem -ffast-math o compilador não vetoriza a soma de floats sozinho.)
+void column_aggregate_block(const ColumnBlock *column_block, int discipline, float min_attendance, ColumnStats *stats)
+{
+    int n = column_block->count;
+    int i = 0;
+#ifdef __SSE2__
+    __m128 sum = _mm_setzero_ps();
+    __m128 min = _mm_set1_ps(stats->min), max = _mm_set1_ps(stats->max);
+    __m128 neutral_min = _mm_set1_ps(1e30f), neutral_max = _mm_set1_ps(-1e30f);
+    __m128 threshold = _mm_set1_ps(min_attendance);
+    __m128i wanted = _mm_set1_epi32(discipline);
+    __m128i all = _mm_set1_epi32(discipline < 0 ? -1 : 0);
+    __m128i count = _mm_setzero_si128(), below = _mm_setzero_si128();
+
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 g = _mm_loadu_ps(&column_block->grade[i]);
+        __m128 a = _mm_loadu_ps(&column_block->attendance[i]);
+        __m128i d = _mm_loadu_si128((const __m128i *)&column_block->discipline[i]);
+        __m128i selected = _mm_or_si128(_mm_cmpeq_epi32(d, wanted), all); // -1: linha selecionada
+        __m128 mask = _mm_castsi128_ps(selected);
+
+        count = _mm_sub_epi32(count, selected);
+        sum = _mm_add_ps(sum, _mm_and_ps(mask, g));
+        min = _mm_min_ps(min, _mm_or_ps(_mm_and_ps(mask, g), _mm_andnot_ps(mask, neutral_min)));
+        max = _mm_max_ps(max, _mm_or_ps(_mm_and_ps(mask, g), _mm_andnot_ps(mask, neutral_max)));
+        below = _mm_sub_epi32(below, _mm_and_si128(selected, _mm_castps_si128(_mm_cmplt_ps(a, threshold))));
+    }
+
+    float sums[4], mins[4], maxs[4];
+    int counts[4], belows[4];
+    _mm_storeu_ps(sums, sum);
+    _mm_storeu_ps(mins, min);
+    _mm_storeu_ps(maxs, max);
+    _mm_storeu_si128((__m128i *)counts, count);
+    _mm_storeu_si128((__m128i *)belows, below);
+    for (int lane = 0; lane < 4; lane++)
+    {
+        stats->count += counts[lane];
+        stats->sum += sums[lane];
+        stats->min = mins[lane] < stats->min ? mins[lane] : stats->min;
+        stats->max = maxs[lane] > stats->max ? maxs[lane] : stats->max;
+        stats->below += belows[lane];
+    }
+#endif
+    column_aggregate_scalar(column_block, i, n, discipline, min_attendance, stats);
+}
+
+// Agrega as médias de uma disciplina (ou de todas, com discipline = -1) e conta as
+// linhas com frequência abaixo de min_attendance, bloco a bloco
+void column_aggregate(int discipline, float min_attendance, ColumnStats *stats)
+{
+    static ColumnBlock column_block; // 20 KB: fora da pilha
+    stats->count = 0;
+    stats->sum = 0;
+    stats->min = 1e30f;
+    stats->max = -1e30f;
+    stats->below = 0;
+
+    for (int block = 0; read_column_block(block, &column_block); block++)
+        column_aggregate_block(&column_block, discipline, min_attendance, stats);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+// Índice secundário por média: árvore-B ordenada por (média, chave) em um arquivo
+// próprio, para listar faixas de médias e as maiores médias sem ler o arquivo de dados
+// inteiro. O arquivo começa com um cabeçalho (identificação, versão e RRN da raiz),
+// seguido das páginas, cada uma com um CRC32C conferido a cada leitura. O índice é
+// derivado do principal: um arquivo de outro formato é refeito na abertura.
+// Uma atualização de média desativa a entrada antiga (record_rrn = NIL) e insere outra.
+// O cabeçalho conta as entradas e as desativadas; quando as desativadas passam de um
+// quarto do total (e de GRADE_DEAD_MIN), o índice é refeito sem elas, então as
+// desativadas nunca passam de um quarto da árvore. O filtro por disciplina não usa o
+// índice: o percurso lê as entradas de todas as disciplinas na faixa de médias e só
+// mostra as da disciplina pedida, então um top-K filtrado custa O(log n + k / fração
+// da disciplina nas médias mais altas), e não O(log n + k).
+
+typedef struct
+{
+    int keycount;                 // Número de entradas na página
+    float grades[MAX_KEYS];       // Média (primeiro critério da ordem)
+    char keys[MAX_KEYS][7];       // Chave "ID+Disciplina" (desempate)
+    long long children[MAX_CHILD]; // RRNs dos filhos
+    long long record_rrn[MAX_KEYS]; // Endereço do registro (NIL: entrada desativada)
+    unsigned int checksum;          // CRC32C dos campos anteriores
+} GradePage;
+
+#define GRADE_MAGIC 0x4E544241 // "ABTN": identifica o index_nota.bin
+#define GRADE_VERSION 3        // 1: só o RRN da raiz; 2: cabeçalho e CRC32C por página; 3: contagem de desativadas
+#define GRADE_DEAD_MIN 1024    // Entradas desativadas toleradas antes de refazer o índice, qualquer que seja o total
+
+// Cabeçalho do index_nota.bin
+typedef struct
+{
+    int magic;          // GRADE_MAGIC
+    int version;        // GRADE_VERSION
+    long long root_rrn; // RRN da raiz
+    long long entries;  // Entradas na árvore, desativadas inclusive
+    long long dead;     // Entradas desativadas (record_rrn = NIL)
+} GradeHeader;
+
+thread_local FILE *gradefd = NULL; // Índice por média mantido aberto (NULL: recurso desativado)
+
+// Compara as entradas (grade_a, key_a) e (grade_b, key_b)
+int grade_compare(float grade_a, const char *key_a, float grade_b, const char *key_b)
+{
+    if (grade_a < grade_b)
+        return -1;
+    if (grade_a > grade_b)
+        return 1;
+    return strcmp(key_a, key_b);
+}
+
+// Retorna 1 se gradefd tem o cabeçalho do formato atual
+int grade_header_valid()
+{
+    GradeHeader header;
+    fseeko(gradefd, 0, SEEK_SET);
+    return fread(&header, sizeof(GradeHeader), 1, gradefd) == 1 && header.magic == GRADE_MAGIC &&
+           header.version == GRADE_VERSION;
+}
+
+GradeHeader grade_read_header()
+{
+    GradeHeader header;
+    fseeko(gradefd, 0, SEEK_SET);
+    if (fread(&header, sizeof(GradeHeader), 1, gradefd) != 1)
+    {
+        printf("Cabecalho de %s ilegivel; apague o arquivo para refaze-lo.\n", GRADE_INDEX_FILENAME);
+        exit(1);
+    }
+    return header;
+}
+
+void grade_write_header(const GradeHeader *header)
+{
+    fseeko(gradefd, 0, SEEK_SET);
+    fwrite(header, sizeof(GradeHeader), 1, gradefd);
+}
+
+long long grade_root()
+{
+    return grade_read_header().root_rrn;
+}
+
+unsigned int grade_page_checksum(const GradePage *page)
+{
+    return crc32c(page, offsetof(GradePage, checksum));
+}
+
+// Lê uma página do índice por média; um arquivo truncado ou uma página com checksum
+// errado interrompem o programa, em vez de o percurso seguir com filhos lixo
+void grade_read_page(long long rrn, GradePage *page)
+{
+    fseeko(gradefd, sizeof(GradeHeader) + rrn * sizeof(GradePage), SEEK_SET);
+    if (fread(page, sizeof(GradePage), 1, gradefd) != 1 || page->checksum != grade_page_checksum(page) ||
+        page->keycount < 0 || page->keycount > MAX_KEYS)
+    {
+        printf("Pagina %lld de %s danificada; apague o arquivo para refaze-lo.\n", rrn, GRADE_INDEX_FILENAME);
+        exit(1);
+    }
+}
+
+void grade_write_page(long long rrn, GradePage *page)
+{
+    page->checksum = grade_page_checksum(page);
+    fseeko(gradefd, sizeof(GradeHeader) + rrn * sizeof(GradePage), SEEK_SET);
+    fwrite(page, sizeof(GradePage), 1, gradefd);
+}
+
+long long grade_getpage()
+{
+    fseeko(gradefd, 0, SEEK_END);
+    return (ftello(gradefd) - (long long)sizeof(GradeHeader)) / (long long)sizeof(GradePage);
+}
+
+void grade_init_page(GradePage *page)
+{
+    memset(page, 0, sizeof(GradePage));
+    for (int i = 0; i < MAX_KEYS; i++)
+    {
+        page->record_rrn[i] = NIL;
+        page->children[i] = NIL;
+    }
+    page->children[MAX_KEYS] = NIL;
+}
+
+// Posição da primeira entrada >= (grade, key); retorna 1 se ela é igual
+int grade_search_node(float grade, const char *key, GradePage *page, int *pos)
+{
+    for (*pos = 0; *pos < page->keycount && grade_compare(grade, key, page->grades[*pos], page->keys[*pos]) > 0; (*pos)++)
+        ;
+    return *pos < page->keycount && grade_compare(grade, key, page->grades[*pos], page->keys[*pos]) == 0;
+}
+
+// Insere uma entrada na árvore do índice por média. Uma entrada igual já existente
+// (média restaurada após uma atualização) é reativada com o novo endereço.
+// As contagens de header são ajustadas. Retorna 1 se houve promoção e 0 caso contrário.
+int grade_insert_in_tree(long long rrn, float grade, char *key, long long record_rrn,
+                         long long *promo_child, float *promo_grade, char *promo_key, long long *promo_rrn,
+                         GradeHeader *header)
+{
+    if (rrn == NIL)
+    {
+        header->entries++;
+        *promo_grade = grade;
+        strcpy(promo_key, key);
+        *promo_rrn = record_rrn;
+        *promo_child = NIL;
+        return 1;
+    }
+
+    GradePage page;
+    int pos;
+    grade_read_page(rrn, &page);
+    if (grade_search_node(grade, key, &page, &pos))
+    {
+        if (page.record_rrn[pos] == NIL)
+            header->dead--;
+        page.record_rrn[pos] = record_rrn;
+        grade_write_page(rrn, &page);
+        return 0;
+    }
+
+    long long p_b_child, p_b_rrn;
+    float p_b_grade;
+    char p_b_key[7];
+    if (!grade_insert_in_tree(page.children[pos], grade, key, record_rrn, &p_b_child, &p_b_grade, p_b_key, &p_b_rrn,
+                              header))
+        return 0;
+
+    // Monta a página com a entrada promovida (uma posição a mais que o máximo)
+    float work_grades[MAX_KEYS + 1];
+    char work_keys[MAX_KEYS + 1][7];
+    long long work_rrns[MAX_KEYS + 1], work_children[MAX_KEYS + 2];
+    int count = page.keycount;
+    for (int j = 0; j < count; j++)
+    {
+        work_grades[j + (j >= pos)] = page.grades[j];
+        strcpy(work_keys[j + (j >= pos)], page.keys[j]);
+        work_rrns[j + (j >= pos)] = page.record_rrn[j];
+    }
+    for (int j = 0; j <= count; j++)
+        work_children[j + (j > pos)] = page.children[j];
+    work_grades[pos] = p_b_grade;
+    strcpy(work_keys[pos], p_b_key);
+    work_rrns[pos] = p_b_rrn;
+    work_children[pos + 1] = p_b_child;
+    count++;
+
+    if (count <= MAX_KEYS)
+    {
+        for (int j = 0; j < count; j++)
+        {
+            page.grades[j] = work_grades[j];
+            strcpy(page.keys[j], work_keys[j]);
+            page.record_rrn[j] = work_rrns[j];
+        }
+        for (int j = 0; j <= count; j++)
+            page.children[j] = work_children[j];
+        page.keycount = count;
+        grade_write_page(rrn, &page);
+        return 0;
+    }
+
+    // Página cheia: divide ao meio e promove a entrada do meio
+    int mid = count / 2;
+    GradePage newpage;
+    grade_init_page(&page);
+    grade_init_page(&newpage);
+    for (int j = 0; j < mid; j++)
+    {
+        page.grades[j] = work_grades[j];
+        strcpy(page.keys[j], work_keys[j]);
+        page.record_rrn[j] = work_rrns[j];
+        page.children[j] = work_children[j];
+    }
+    page.children[mid] = work_children[mid];
+    page.keycount = mid;
+    for (int j = mid + 1; j < count; j++)
+    {
+        newpage.grades[j - mid - 1] = work_grades[j];
+        strcpy(newpage.keys[j - mid - 1], work_keys[j]);
+        newpage.record_rrn[j - mid - 1] = work_rrns[j];
+        newpage.children[j - mid - 1] = work_children[j];
+    }
+    newpage.children[count - mid - 1] = work_children[count];
+    newpage.keycount = count - mid - 1;
+
+    *promo_grade = work_grades[mid];
+    strcpy(promo_key, work_keys[mid]);
+    *promo_rrn = work_rrns[mid];
+    *promo_child = grade_getpage();
+    grade_write_page(rrn, &page);
+    grade_write_page(*promo_child, &newpage);
+    return 1;
+}
+
+// Acrescenta (grade, key) ao índice por média
+void grade_index_add(float grade, char *key, long long record_rrn)
+{
+    if (!gradefd)
+        return;
+
+    GradeHeader header = grade_read_header();
+    long long root = header.root_rrn;
+    long long promo_child, promo_rrn;
+    float promo_grade;
+    char promo_key[7];
+    if (grade_insert_in_tree(root, grade, key, record_rrn, &promo_child, &promo_grade, promo_key, &promo_rrn, &header))
+    {
+        GradePage new_root;
+        grade_init_page(&new_root);
+        new_root.grades[0] = promo_grade;
+        strcpy(new_root.keys[0], promo_key);
+        new_root.record_rrn[0] = promo_rrn;
+        new_root.children[0] = root;
+        new_root.children[1] = promo_child;
+        new_root.keycount = 1;
+
+        header.root_rrn = grade_getpage();
+        grade_write_page(header.root_rrn, &new_root);
+    }
+    grade_write_header(&header);
+    fflush(gradefd);
+}
+
+// Desativa a entrada (grade, key) do índice por média
+void grade_index_remove(float grade, char *key)
+{
+    if (!gradefd)
+        return;
+
+    GradeHeader header = grade_read_header();
+    long long rrn = header.root_rrn;
+    GradePage page;
+    int pos;
+    while (rrn != NIL)
+    {
+        grade_read_page(rrn, &page);
+        if (grade_search_node(grade, key, &page, &pos))
+        {
+            if (page.record_rrn[pos] == NIL)
+                return;
+            page.record_rrn[pos] = NIL;
+            grade_write_page(rrn, &page);
+            header.dead++;
+            grade_write_header(&header);
+            fflush(gradefd);
+            return;
+        }
+        rrn = page.children[pos];
+    }
+}
+
+// Acrescenta ao índice por média as entradas da subárvore rrn do índice principal
+void grade_rebuild_page(FILE *data_file, long long rrn)
+{
+    if (rrn == NIL)
+        return;
+
+    BTreePage page;
+    read_page(rrn, &page);
+    for (int i = 0; i < page.keycount; i++)
+    {
+        grade_rebuild_page(data_file, page.children[i]);
+
+        StudentRecord student;
+        fseeko(data_file, page.record_rrn[i], SEEK_SET);
+        if (read_student(data_file, &student))
+            grade_index_add(student.grade, page.keys[i], page.record_rrn[i]);
+    }
+    grade_rebuild_page(data_file, page.children[page.keycount]);
+}
+
+// Refaz o índice por média a partir do índice principal (descarta entradas desativadas)
+void grade_rebuild(FILE *data_file, long long root)
+{
+    if (!gradefd)
+        return;
+
+    fclose(gradefd);
+    gradefd = fopen(GRADE_INDEX_FILENAME, "wb+");
+    if (!gradefd)
+    {
+        perror("Erro ao refazer o índice por média");
+        exit(1);
+    }
+    GradeHeader header = {GRADE_MAGIC, GRADE_VERSION, NIL, 0, 0};
+    grade_write_header(&header);
+    grade_rebuild_page(data_file, root);
+    fflush(gradefd);
+}
+
+// Refaz o índice por média quando as entradas desativadas passam de um quarto do total
+void grade_compact(FILE *data_file, FILE *index_file)
+{
+    if (!gradefd)
+        return;
+
+    GradeHeader header = grade_read_header();
+    if (header.dead < GRADE_DEAD_MIN || header.dead * 4 < header.entries)
+        return;
+    printf("Indice por media: %lld de %lld entradas desativadas; refazendo.\n", header.dead, header.entries);
+    grade_rebuild(data_file, read_header(index_file).root_rrn);
+}
+
+// Visita uma entrada do índice por média: lê e mostra o registro.
+// Retorna 0 quando o limite de registros foi atingido.
+int grade_visit(FILE *data_file, GradePage *page, int i, const char *discipline, int *remaining)
+{
+    if (page->record_rrn[i] == NIL || (discipline && strcmp(page->keys[i] + 3, discipline) != 0))
+        return 1;
+
+    StudentRecord student;
+    fseeko(data_file, page->record_rrn[i], SEEK_SET);
+    if (read_student(data_file, &student))
+        printf("ID: %s, Disciplina: %s, Nome: %s, Média: %.2f, Frequência: %.2f\n",
+               student.id, student.discipline, student.name, student.grade, student.attendance);
+    return --(*remaining) != 0;
+}
+
+// Percorre em ordem crescente (ou decrescente) as entradas com média em [lo, hi],
+// opcionalmente só de uma disciplina. Subárvores fora da faixa não são lidas e o
+// percurso para assim que sai da faixa ou mostra *remaining registros (negativo: sem limite).
+// Retorna 0 quando o percurso terminou.
+int grade_scan(FILE *data_file, long long rrn, float lo, float hi, int descending, const char *discipline, int *remaining)
+{
+    if (rrn == NIL)
+        return 1;
+
+    GradePage page;
+    grade_read_page(rrn, &page);
+    int n = page.keycount;
+
+    for (int k = 0; k <= n; k++)
+    {
+        int i = descending ? n - k : k;
+
+        // O filho i guarda médias entre grades[i - 1] e grades[i]
+        int skip = (i < n && page.grades[i] < lo) || (i > 0 && page.grades[i - 1] > hi);
+        if (!skip && !grade_scan(data_file, page.children[i], lo, hi, descending, discipline, remaining))
+            return 0;
+
+        // Entrada seguinte na ordem do percurso
+        int e = descending ? i - 1 : i;
+        if (e < 0 || e >= n)
+            continue;
+        if (descending ? page.grades[e] < lo : page.grades[e] > hi)
+            return 0;
+        if (page.grades[e] >= lo && page.grades[e] <= hi && !grade_visit(data_file, &page, e, discipline, remaining))
+            return 0;
+    }
+    return 1;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+// Estrutura para uma atualização de média e frequência
+typedef struct
+{
+    char key[7];      // Chave ("ID+Disciplina")
+    float grade;      // Nova média
+    float attendance; // Nova frequência
+    long long record_rrn; // Endereço do registro no arquivo de dados (resolvido pelo índice)
+} GradeUpdate;
+
+// Sobrescreve média e frequência do registro que começa em record_rrn.
+// Os dois campos ficam sempre no fim do registro, então só esses bytes são regravados.
+// Retorna a média que estava gravada, para o índice por média
+float write_grade_fields(FILE *data_file, long long record_rrn, float grade, float attendance)
+{
+    int size;
+    float old_grade;
+    fseeko(data_file, record_rrn, SEEK_SET);
+    fread(&size, sizeof(int), 1, data_file);
+
+    // Fim do registro: ...#media#frequencia
+    long long grade_offset = record_rrn + sizeof(int) + size - sizeof(float) - 1 - sizeof(float);
+    fseeko(data_file, grade_offset, SEEK_SET);
+    fread(&old_grade, sizeof(float), 1, data_file);
+    fseeko(data_file, grade_offset, SEEK_SET);
+    fwrite(&grade, sizeof(float), 1, data_file);
+    fseeko(data_file, 1, SEEK_CUR); // Pula o delimitador '#'
+    fwrite(&attendance, sizeof(float), 1, data_file);
+    return old_grade;
+}
+
+// Atualiza a média e a frequência de um aluno sem reinserir o registro
+int update_student(FILE *data_file, FILE *index_file, char *key, float grade, float attendance)
+{
+    Header header = read_header(index_file);
+    long long page_rrn, record_rrn;
+    int pos;
+
+    if (!search_in_tree(header.root_rrn, key, &page_rrn, &pos, &record_rrn))
+    {
+        printf("Chave %s não encontrada\n", key);
+        return 0;
+    }
+
+    float old_grade = write_grade_fields(data_file, record_rrn, grade, attendance);
+    fflush(data_file);
+    if (cow_mode)
+    {
+        // As páginas antigas continuam intactas para a raiz antiga (o registro de dados,
+        // acima, já foi regravado no lugar)
+        long long new_root;
+        KeyFields fields = {grade, attendance};
+        cow_update_fields(header.root_rrn, key, fields, &new_root);
+        cow_publish_root(index_file, header.root_rrn, new_root);
+    }
+    else
+        update_key_fields(page_rrn, pos, grade, attendance);
+    column_update(record_rrn, grade, attendance);
+    grade_index_remove(old_grade, key);
+    grade_index_add(grade, key, record_rrn);
+    grade_compact(data_file, index_file);
+    printf("Chave %s atualizada\n", key);
+    return 1;
+}
+
+// Compara atualizações pelo endereço no arquivo de dados (para o qsort)
+int compare_update_offset(const void *a, const void *b)
+{
+    const GradeUpdate *ua = (const GradeUpdate *)a;
+    const GradeUpdate *ub = (const GradeUpdate *)b;
+    return (ua->record_rrn > ub->record_rrn) - (ua->record_rrn < ub->record_rrn);
+}
+
+// Aplica várias atualizações de uma vez: resolve os endereços pelo índice e
+// grava em ordem crescente de endereço, para percorrer o arquivo de dados uma só vez.
+// Retorna o número de registros atualizados.
+int update_students(FILE *data_file, FILE *index_file, GradeUpdate *updates, int count)
+{
+    Header header = read_header(index_file);
+    long long page_rrn;
+    int pos;
+    int found = 0;
+
+    // No modo cópia-na-escrita cada atualização copia o caminho a partir da raiz nova
+    // (ainda não publicada) e o lote inteiro é publicado de uma vez no fim
+    long long root = header.root_rrn;
+    for (int i = 0; i < count; i++)
+    {
+        if (search_in_tree(root, updates[i].key, &page_rrn, &pos, &updates[i].record_rrn))
+        {
+            if (cow_mode)
+            {
+                KeyFields fields = {updates[i].grade, updates[i].attendance};
+                cow_update_fields(root, updates[i].key, fields, &root);
+            }
+            else
+                update_key_fields(page_rrn, pos, updates[i].grade, updates[i].attendance);
+            updates[found++] = updates[i];
+        }
+        else
+            printf("Chave %s não encontrada\n", updates[i].key);
+    }
+    if (cow_mode)
+        cow_publish_root(index_file, header.root_rrn, root);
+
+    qsort(updates, found, sizeof(GradeUpdate), compare_update_offset);
+
+    for (int i = 0; i < found; i++)
+    {
+        float old_grade = write_grade_fields(data_file, updates[i].record_rrn, updates[i].grade, updates[i].attendance);
+        column_update(updates[i].record_rrn, updates[i].grade, updates[i].attendance);
+        grade_index_remove(old_grade, updates[i].key);
+        grade_index_add(updates[i].grade, updates[i].key, updates[i].record_rrn);
+    }
+    fflush(data_file);
+    grade_compact(data_file, index_file);
+
+    printf("%d registros atualizados\n", found);
+    return found;
+}
+
+// Aplica o arquivo de lote inteiro, MAX_ATUALIZA atualizações por vez (cada bloco
+// é ordenado e aplicado em uma passada). Retorna o número de registros atualizados.
+long long update_students_from_file(FILE *data_file, FILE *index_file, const char *filename)
+{
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL)
+    {
+        printf("Nao foi possivel abrir o arquivo.\n");
+        return 0;
+    }
+
+    std::vector<struct atualiza> vet_a(MAX_ATUALIZA);
+    std::vector<GradeUpdate> updates(MAX_ATUALIZA);
+    long long read = 0, updated = 0;
+    int count;
+    while ((count = fread(&vet_a[0], sizeof(struct atualiza), MAX_ATUALIZA, file)) > 0)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            memcpy(updates[i].key, vet_a[i].id_aluno, 3);
+            memcpy(updates[i].key + 3, vet_a[i].sigla_disc, 3);
+            updates[i].key[6] = '\0';
+            updates[i].grade = vet_a[i].media;
+            updates[i].attendance = vet_a[i].frequencia;
+        }
+        updated += update_students(data_file, index_file, &updates[0], count);
+        read += count;
+    }
+
+    // Um registro incompleto no fim do arquivo não é aplicado, mas é avisado
+    long long leftover = ftello(file) - read * (long long)sizeof(struct atualiza);
+    fclose(file);
+    if (leftover > 0)
+        printf("Aviso: %lld bytes no fim de %s nao formam uma atualizacao completa e foram ignorados\n", leftover, filename);
+    printf("Lote: %lld atualizacoes lidas, %lld registros atualizados\n", read, updated);
+    return updated;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void split(char *key, long long r_child, long long r_count, long long rrn, KeyFields fields, BTreePage *p_oldpage,
+           char *promo_key, long long *promo_r_child, BTreePage *p_newpage, long long *promo_rrn, KeyFields *promo_fields)
+{
+    int mid = 2;
+    char temp_keys[MAX_KEYS + 1][7];
+    long long temp_children[MAX_CHILD + 1];
+    long long temp_counts[MAX_CHILD + 1];
+    long long temp_rrns[MAX_KEYS + 1];
+    KeyFields temp_fields[MAX_KEYS + 1];
+
+    for (int i = 0; i < MAX_KEYS; i++)
+    {
+        strcpy(temp_keys[i], p_oldpage->keys[i]);
+        temp_children[i] = p_oldpage->children[i];
+        temp_counts[i] = p_oldpage->child_count[i];
         temp_rrns[i] = p_oldpage->record_rrn[i];
+        temp_fields[i] = p_oldpage->fields[i];
+    }
+    temp_children[MAX_KEYS] = p_oldpage->children[MAX_KEYS];
+    temp_counts[MAX_KEYS] = p_oldpage->child_count[MAX_KEYS];
+
+    // Insere a nova chave no lugar apropriado
+    int i;
+    for (i = MAX_KEYS; i > 0 && strcmp(key, temp_keys[i - 1]) < 0; i--)
+    {
+        strcpy(temp_keys[i], temp_keys[i - 1]);
+        temp_children[i + 1] = temp_children[i];
+        temp_counts[i + 1] = temp_counts[i];
+        temp_rrns[i] = temp_rrns[i - 1];
+        temp_fields[i] = temp_fields[i - 1];
+    }
+    strcpy(temp_keys[i], key);
+    temp_children[i + 1] = r_child;
+    temp_counts[i + 1] = r_count;
+    temp_rrns[i] = rrn;
+    temp_fields[i] = fields;
+
+    init_page(p_newpage);
+    *promo_r_child = getpage();
+    *promo_rrn = temp_rrns[mid];
+    *promo_fields = temp_fields[mid];
+    strcpy(promo_key, temp_keys[mid]);
+    printf("Chave %s promovida\n", promo_key);
+
+    // Divide os elementos na página antiga e na nova
+    for (int j = 0; j < mid; j++)
+    {
+        strcpy(p_oldpage->keys[j], temp_keys[j]);
+        p_oldpage->children[j] = temp_children[j];
+        p_oldpage->child_count[j] = temp_counts[j];
+        p_oldpage->record_rrn[j] = temp_rrns[j];
+        p_oldpage->fields[j] = temp_fields[j];
+    }
+    p_oldpage->children[mid] = temp_children[mid];
+    p_oldpage->child_count[mid] = temp_counts[mid];
+    for (int j = mid; j < MAX_KEYS; j++)
+    {
+        memset(p_oldpage->keys[j], '\0', sizeof(p_oldpage->keys[j]));
+        p_oldpage->children[j + 1] = NIL;
+        p_oldpage->child_count[j + 1] = 0;
+        p_oldpage->record_rrn[j] = NIL;
+        memset(&p_oldpage->fields[j], 0, sizeof(KeyFields));
+    }
+    p_oldpage->keycount = mid;
+
+    for (int j = mid + 1; j <= MAX_KEYS; j++)
+    {
+        strcpy(p_newpage->keys[j - mid - 1], temp_keys[j]);
+        p_newpage->children[j - mid - 1] = temp_children[j];
+        p_newpage->child_count[j - mid - 1] = temp_counts[j];
+        p_newpage->record_rrn[j - mid - 1] = temp_rrns[j];
+        p_newpage->fields[j - mid - 1] = temp_fields[j];
+    }
+    p_newpage->children[MAX_KEYS - mid] = temp_children[MAX_CHILD];
+    p_newpage->child_count[MAX_KEYS - mid] = temp_counts[MAX_CHILD];
+    p_newpage->keycount = MAX_KEYS - mid;
+}
+
+int insert_policy = POLICY_SPLIT; // Política de inserção em folha cheia
+
+// Junta as chaves de duas folhas vizinhas, o separador entre elas e a chave nova, em ordem
+int gather_leaf_entries(BTreePage *left, BTreePage *parent, int sep, BTreePage *right, char *key, long long record_rrn, KeyFields fields,
+                        char keys[][7], long long rrns[], KeyFields entry_fields[])
+{
+    int n = 0;
+    for (int i = 0; i < left->keycount; i++, n++)
+    {
+        strcpy(keys[n], left->keys[i]);
+        rrns[n] = left->record_rrn[i];
+        entry_fields[n] = left->fields[i];
+    }
+    strcpy(keys[n], parent->keys[sep]);
+    rrns[n] = parent->record_rrn[sep];
+    entry_fields[n++] = parent->fields[sep];
+    for (int i = 0; i < right->keycount; i++, n++)
+    {
+        strcpy(keys[n], right->keys[i]);
+        rrns[n] = right->record_rrn[i];
+        entry_fields[n] = right->fields[i];
+    }
+
+    int i;
+    for (i = n; i > 0 && strcmp(key, keys[i - 1]) < 0; i--)
+    {
+        strcpy(keys[i], keys[i - 1]);
+        rrns[i] = rrns[i - 1];
+        entry_fields[i] = entry_fields[i - 1];
+    }
+    strcpy(keys[i], key);
+    rrns[i] = record_rrn;
+    entry_fields[i] = fields;
+    return n + 1;
+}
+
+// Preenche uma folha com count entradas a partir de keys[from]
+void fill_leaf(BTreePage *page, char keys[][7], long long rrns[], KeyFields entry_fields[], int from, int count)
+{
+    init_page(page);
+    for (int i = 0; i < count; i++)
+    {
+        strcpy(page->keys[i], keys[from + i]);
+        page->record_rrn[i] = rrns[from + i];
+        page->fields[i] = entry_fields[from + i];
+    }
+    page->keycount = count;
+}
+
+// Insere a chave na folha cheia child (filho pos de page) sem dividi-la ao meio:
+// primeiro tenta repassar chaves para a irmã esquerda ou direita, atualizando o separador;
+// se as duas estiverem cheias, divide as duas folhas em três (2-para-3).
+// Quando a chave nova é a maior do grupo (carga crescente, que sempre cresce pela borda
+// direita), as folhas da esquerda ficam cheias e só a última fica com a sobra; quando é a
+// menor (carga decrescente), o contrário. Nas outras inserções as entradas são
+// repartidas por igual.
+// Retorna 0 se page já foi gravada, ou 1 se ainda é preciso inserir promo_key em page
+// (promo_count recebe o número de chaves da folha nova).
+int insert_with_redistribution(long long rrn, BTreePage *page, int pos, BTreePage *child, char *key, long long record_rrn, KeyFields fields,
+                               long long *promo_child, char *promo_key, long long *promo_rrn, KeyFields *promo_fields, long long *promo_count)
+{
+    char keys[2 * MAX_KEYS + 2][7];
+    long long rrns[2 * MAX_KEYS + 2];
+    KeyFields entry_fields[2 * MAX_KEYS + 2];
+    BTreePage sibling;
+
+    // Tenta a irmã esquerda e depois a direita
+    for (int side = -1; side <= 1; side += 2)
+    {
+        int sibling_pos = pos + side;
+        if (sibling_pos < 0 || sibling_pos > page->keycount)
+            continue;
+
+        read_page(page->children[sibling_pos], &sibling);
+        if (sibling.keycount == MAX_KEYS)
+            continue;
+
+        int sep = side < 0 ? sibling_pos : pos; // Separador entre as duas folhas
+        long long left_rrn = page->children[sep], right_rrn = page->children[sep + 1];
+        BTreePage *left = side < 0 ? &sibling : child;
+        BTreePage *right = side < 0 ? child : &sibling;
+
+        int n = gather_leaf_entries(left, page, sep, right, key, record_rrn, fields, keys, rrns, entry_fields);
+        int left_count = (n - 1) / 2;
+        if (strcmp(keys[n - 1], key) == 0)
+            left_count = n - 2 < MAX_KEYS ? n - 2 : MAX_KEYS; // A direita fica com pelo menos uma
+        else if (strcmp(keys[0], key) == 0)
+            left_count = n - 1 - MAX_KEYS > 1 ? n - 1 - MAX_KEYS : 1;
+        fill_leaf(left, keys, rrns, entry_fields, 0, left_count);
+        fill_leaf(right, keys, rrns, entry_fields, left_count + 1, n - left_count - 1);
+        strcpy(page->keys[sep], keys[left_count]);
+        page->record_rrn[sep] = rrns[left_count];
+        page->fields[sep] = entry_fields[left_count];
+        page->child_count[sep] = left->keycount;
+        page->child_count[sep + 1] = right->keycount;
+
+        printf("Redistribuicao entre irmaos\n");
+        write_page(left_rrn, left);
+        write_page(right_rrn, right);
+        write_page(rrn, page);
+        return 0;
+    }
+
+    // As irmãs estão cheias: divide a folha e uma irmã em três folhas
+    int sep = pos < page->keycount ? pos : pos - 1;
+    long long left_rrn = page->children[sep], right_rrn = page->children[sep + 1];
+    read_page(page->children[sep == pos ? pos + 1 : sep], &sibling);
+    BTreePage *left = sep == pos ? child : &sibling;
+    BTreePage *right = sep == pos ? &sibling : child;
+
+    int n = gather_leaf_entries(left, page, sep, right, key, record_rrn, fields, keys, rrns, entry_fields);
+    int first = (n - 2) / 3;
+    int second = (n - 2 - first) / 2;
+    if (strcmp(keys[n - 1], key) == 0)
+    {
+        // Com 2 * MAX_KEYS + 2 entradas: MAX_KEYS, MAX_KEYS - 1 e 1 chave
+        first = MAX_KEYS;
+        second = n - 3 - first < MAX_KEYS ? n - 3 - first : MAX_KEYS;
+    }
+    else if (strcmp(keys[0], key) == 0)
+    {
+        // Simétrico: 1, MAX_KEYS - 1 e MAX_KEYS chaves
+        int last = MAX_KEYS;
+        second = n - 3 - last < MAX_KEYS ? n - 3 - last : MAX_KEYS;
+        first = n - 2 - last - second;
+    }
+    int third = n - 2 - first - second;
+
+    BTreePage newpage;
+    fill_leaf(left, keys, rrns, entry_fields, 0, first);
+    fill_leaf(right, keys, rrns, entry_fields, first + 1, second);
+    fill_leaf(&newpage, keys, rrns, entry_fields, first + second + 2, third);
+    strcpy(page->keys[sep], keys[first]);
+    page->record_rrn[sep] = rrns[first];
+    page->fields[sep] = entry_fields[first];
+    page->child_count[sep] = left->keycount;
+    page->child_count[sep + 1] = right->keycount;
+    *promo_count = newpage.keycount;
+
+    printf("Divisao 2-para-3\n");
+    write_page(left_rrn, left);
+    write_page(right_rrn, right);
+    *promo_child = getpage();
+    write_page(*promo_child, &newpage);
+
+    // O segundo separador sobe para page, com a folha nova à direita
+    strcpy(promo_key, keys[first + second + 1]);
+    *promo_rrn = rrns[first + second + 1];
+    *promo_fields = entry_fields[first + second + 1];
+    return 1;
+}
+
+// promo_count recebe o número de chaves da subárvore promo_child
+int insert_in_tree(long long rrn, char *key, long long record_rrn, KeyFields fields,
+                   long long *promo_child, char *promo_key, long long *promo_rrn, KeyFields *promo_fields, long long *promo_count)
+{
+    //BTreePage page;
+
+    BTreePage page, newpage;
+    //Current page / new page if split occurs
+    
+    long long p_b_rrn;   // rrn promoted from below
+    long long p_b_child; // filho direito promovido de baixo
+    char p_b_key[7]; //chave promoted from below
+    KeyFields p_b_fields; // média e frequência promovidas de baixo
+
+    if (rrn == NIL)
+    {
+        // Caso base: se o nó é NIL, a chave deve ser promovida ao nível superior
+        strcpy(promo_key, key);
+        *promo_rrn = record_rrn;
+        *promo_fields = fields;
+        printf("Record rrn: %lld\n", record_rrn);
+        *promo_child = NIL;
+        *promo_count = 0;
+        return 1; // Indica que a promoção ocorreu
+    }
+
+    //printf("Passou 1\n");
+
+    read_page(rrn, &page);
+
+    //printf("Passou read_page. \n");
+
+    int pos;
+    int found = search_node(key, &page, &pos);
+
+    if (found)
+    {
+        printf("Chave %s duplicada\n", key);
+        return -1; // Indica falha na inserção por chave duplicada
+    }
+
+    //printf("Vai entrar prox insert tree. \n");
+
+    int promoted;
+    int handled = 0;
+    if (insert_policy == POLICY_REDISTRIBUTE && page.children[pos] != NIL)
+    {
+        // Se o filho é uma folha cheia, evita a divisão ao meio
+        BTreePage child;
+        read_page(page.children[pos], &child);
+        if (child.children[0] == NIL && child.keycount == MAX_KEYS)
+        {
+            int child_pos;
+            if (search_node(key, &child, &child_pos))
+            {
+                printf("Chave %s duplicada\n", key);
+                return -1;
+            }
+            promoted = insert_with_redistribution(rrn, &page, pos, &child, key, record_rrn, fields, promo_child, promo_key, promo_rrn, promo_fields, promo_count);
+            handled = 1;
+        }
+    }
+
+    // Chamada recursiva para inserir no filho apropriado
+    if (!handled)
+        promoted = insert_in_tree(page.children[pos], key, record_rrn, fields, promo_child, promo_key, promo_rrn, promo_fields, promo_count);
+
+    //printf("Passou o insert tree. \n");
+
+    if (promoted == -1)
+        return -1; // Retorna imediatamente se houve uma duplicação de chave
+    if (promoted == 0)
+    {
+        // A subárvore do filho ganhou uma chave (na redistribuição page já foi gravada)
+        if (!handled)
+        {
+            page.child_count[pos]++;
+            write_page(rrn, &page);
+        }
+        return 0; // Caso não ocorra promoção, termina a função
+    }
+
+    // O filho foi dividido: a parte esquerda fica com o que não subiu nem foi para a direita
+    if (!handled)
+        page.child_count[pos] -= *promo_count;
+
+    //printf("Passou dos verificadores de promocao e duplicata. \n");
+
+    // Se há espaço na página, insere a chave promovida na posição correta
+    if (page.keycount < MAX_KEYS)
+    {
+        //printf("Entrou em page.keycount < MAX_KEYS .\n");
+        insert_in_page(promo_key, *promo_rrn, *promo_fields, *promo_child, *promo_count, &page);
+        write_page(rrn, &page);
+        return 0; // Não ocorre promoção adicional
+    }
+    else
+    {
+        // Divisão do nó: ocorre promoção de uma chave para o nível superior
+        printf("Divisao de no\n");
+        //split(promo_key, *promo_rrn, *promo_child, &page, promo_key, promo_rrn, promo_child);
+        // Copia a promoção vinda de baixo, pois promo_* também são as saídas do split
+        strcpy(p_b_key, promo_key);
+        p_b_rrn = *promo_rrn;
+        p_b_child = *promo_child;
+        p_b_fields = *promo_fields;
+        split(p_b_key, p_b_child, *promo_count, p_b_rrn, p_b_fields, &page, promo_key, promo_child, &newpage, promo_rrn, promo_fields);
+        *promo_count = subtree_count(&newpage);
+
+        write_page(rrn, &page);
+        write_page(*promo_child, &newpage);
+        return 1; // Indica que uma promoção adicional ocorreu
+    }
+}
+
+// Modo cópia-na-escrita (copy-on-write): nenhuma página existente é sobrescrita.
+// A inserção grava versões novas das páginas do caminho no fim do índice e só no
+// final publica a nova raiz no cabeçalho. Quem guardou um root_rrn continua vendo
+// uma árvore consistente (um snapshot), sem travas, mesmo durante inserções.
+// O snapshot cobre só as páginas do índice: uma atualização regrava média e frequência
+// do registro no arquivo de dados (e no arquivo colunar e no índice por média) no lugar,
+// então pela raiz antiga a cópia na página mostra os valores antigos e o registro lido
+// pelo endereço já mostra os novos. O programa ainda não tem leitores que guardem uma
+// raiz enquanto há inserções; cada operação relê a raiz do cabeçalho.
+// As versões antigas são recolhidas por vacuum_index.
+
+// Insere a chave copiando o caminho da raiz até a folha.
+// new_rrn recebe o endereço da nova versão da página rrn (NIL se rrn é NIL).
+int cow_insert_in_tree(long long rrn, char *key, long long record_rrn, KeyFields fields, long long *new_rrn,
+                       long long *promo_child, char *promo_key, long long *promo_rrn, KeyFields *promo_fields, long long *promo_count)
+{
+    BTreePage page, newpage;
+    long long p_b_rrn, p_b_child;
+    char p_b_key[7];
+    KeyFields p_b_fields;
+
+    if (rrn == NIL)
+    {
+        strcpy(promo_key, key);
+        *promo_rrn = record_rrn;
+        *promo_fields = fields;
+        *promo_child = NIL;
+        *promo_count = 0;
+        *new_rrn = NIL;
+        return 1;
+    }
+
+    read_page(rrn, &page);
+
+    int pos;
+    if (search_node(key, &page, &pos))
+    {
+        printf("Chave %s duplicada\n", key);
+        return -1;
+    }
+
+    long long child_rrn;
+    int promoted = cow_insert_in_tree(page.children[pos], key, record_rrn, fields, &child_rrn, promo_child, promo_key, promo_rrn, promo_fields, promo_count);
+    if (promoted == -1)
+        return -1;
+
+    // A página passa a apontar para a nova versão do filho, que ganhou uma chave
+    // (ou foi dividida, ficando sem as chaves que subiram ou foram para a direita)
+    page.children[pos] = child_rrn;
+    if (promoted == 1)
+        page.child_count[pos] -= *promo_count;
+    else
+        page.child_count[pos]++;
+
+    if (promoted == 1 && page.keycount == MAX_KEYS)
+    {
+        printf("Divisao de no\n");
+        strcpy(p_b_key, promo_key);
+        p_b_rrn = *promo_rrn;
+        p_b_child = *promo_child;
+        p_b_fields = *promo_fields;
+        split(p_b_key, p_b_child, *promo_count, p_b_rrn, p_b_fields, &page, promo_key, promo_child, &newpage, promo_rrn, promo_fields);
+        *promo_count = subtree_count(&newpage);
+        write_page(*promo_child, &newpage);
+
+        *new_rrn = getpage();
+        write_page(*new_rrn, &page);
+        return 1;
+    }
+
+    if (promoted == 1)
+        insert_in_page(promo_key, *promo_rrn, *promo_fields, *promo_child, *promo_count, &page);
+
+    *new_rrn = getpage();
+    write_page(*new_rrn, &page);
+    return 0;
+}
+
+// Insere o registro no arquivo de dados e a chave na árvore, sem mexer nos contadores.
+// Retorna 1 se o aluno foi inserido, 0 se a chave já existia
+int insert_record(FILE *index_file, FILE *data_file, StudentRecord *student)
+{
+    Header header = read_header(index_file);
+
+    char key[7];
+    sprintf(key, "%s%s", student->id, student->discipline);
+
+    long long promo_child, promo_count;
+    char promo_key[7];
+    long long promo_rrn;
+    KeyFields fields = {student->grade, student->attendance}, promo_fields;
+
+    long long root = page_cache ? page_cache_root : header.root_rrn; // Na fusão, a raiz ainda não publicada
+    fseeko(data_file, 0, SEEK_END);
+    long long record_rrn = ftello(data_file) /*/ sizeof(StudentRecord)*/;
+
+    // Primeiro, tentamos inserir na árvore-B
+    long long new_root = root;
+    int promoted;
+    if (cow_mode)
+        promoted = cow_insert_in_tree(root, key, record_rrn, fields, &new_root, &promo_child, promo_key, &promo_rrn, &promo_fields, &promo_count);
+    else
+        promoted = insert_in_tree(root, key, record_rrn, fields, &promo_child, promo_key, &promo_rrn, &promo_fields, &promo_count);
+
+    // Se a chave é duplicada, atualiza o contador e retorna
+    if (promoted == -1)
+    {
+        // printf("Chave %s duplicada\n", key);
+        return 0; // Termina a função
+    }
+
+    // Se a chave não for duplicada, insere o registro no arquivo de dados
+    
+    write_student(data_file, student);
+    column_append(record_rrn, student);
+    grade_index_add(student->grade, key, record_rrn);
+
+    // Atualiza a árvore com o RRN correto do registro
+    if (promoted == 1)
+    {
+        // Caso a promoção ocorra na raiz, cria uma nova raiz (set_root grava o cabeçalho)
+        create_root(promo_key, promo_rrn, promo_fields, new_root, promo_child);
+    }
+    else if (new_root != root)
+    {
+        // Cópia-na-escrita: as páginas novas já estão no arquivo; publica a nova raiz
+        fflush(index_file);
+        set_root(new_root);
+    }
+
+    printf("Chave %s inserida com sucesso\n", key);
+    return 1;
+}
+
+// Retorna 1 se o aluno foi inserido, 0 se a chave já existia
+int insert_student(FILE *index_file, FILE *data_file, StudentRecord *student)
+{
+    int inserted = insert_record(index_file, data_file, student);
+    count_operations(index_file, 1, 0); // Conta a inserção, mesmo para chaves duplicadas
+    return inserted;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+// Modo de ingestão com memtable: inserções vão para um mapa ordenado em memória (BTreeMap)
+// e só chegam ao arquivo de dados e ao índice quando ele enche (ou antes de operações que
+// leem o índice inteiro, e na saída). A fusão insere as chaves em ordem, com a cache de
+// páginas ligada: as páginas que recebem várias chaves são lidas e gravadas uma vez, e os
+// registros são acrescentados ao arquivo de dados em ordem de chave.
+
+#define MEMTABLE_CAPACITY 4096 // Chaves na memtable antes de uma fusão, se nada for configurado
+
+// Chave da memtable (char[7] com a ordem de strcmp)
+struct MemtableKey
+{
+    char key[7];
+    bool operator<(const MemtableKey &other) const { return strcmp(key, other.key) < 0; }
+};
+
+typedef BTreeMap<MemtableKey, StudentRecord> Memtable;
+
+Memtable *memtable = NULL; // NULL: inserções vão direto para o índice
+int memtable_capacity = MEMTABLE_CAPACITY;
+
+// Procura key na memtable
+int memtable_find(char *key, StudentRecord *student)
+{
+    if (!memtable)
+        return 0;
+
+    MemtableKey memtable_key;
+    strcpy(memtable_key.key, key);
+    StudentRecord *found = memtable->find(memtable_key);
+    if (found)
+        *student = *found;
+    return found != NULL;
+}
+
+// Funde a memtable ao índice e ao arquivo de dados, em ordem de chave
+void memtable_flush(FILE *index_file, FILE *data_file)
+{
+    if (!memtable || memtable->size() == 0)
+        return;
+
+    long long merged = 0;
+    page_cache_begin();
+    for (Memtable::iterator it = memtable->begin(); it != memtable->end(); ++it)
+    {
+        StudentRecord student = it.value();
+        merged += insert_record(index_file, data_file, &student);
+    }
+    long long written = page_cache_end();
+    fflush(data_file);
+
+    delete memtable;
+    memtable = new Memtable();
+    printf("Memtable: %lld chaves fundidas ao indice, %lld paginas gravadas\n", merged, written);
+}
+
+// Insere na memtable, recusando chaves que já estão nela ou na árvore; funde quando enche.
+// Retorna 1 se o aluno foi aceito, 0 se a chave já existia.
+int memtable_insert(FILE *index_file, FILE *data_file, StudentRecord *student)
+{
+    MemtableKey key;
+    sprintf(key.key, "%s%s", student->id, student->discipline);
+
+    long long page_rrn, record_rrn;
+    int pos;
+    count_operations(index_file, 1, 0); // Conta a inserção, mesmo para chaves duplicadas
+    if (memtable->find(key) || search_in_tree(read_header(index_file).root_rrn, key.key, &page_rrn, &pos, &record_rrn))
+    {
+        printf("Chave %s duplicada\n", key.key);
+        return 0;
+    }
+
+    memtable->insert(key, *student);
+    printf("Chave %s inserida na memtable\n", key.key);
+    if ((int)memtable->size() >= memtable_capacity)
+        memtable_flush(index_file, data_file);
+    return 1;
+}
+
+// Insere pela memtable, se ela estiver ligada, ou direto no índice
+int ingest_student(FILE *index_file, FILE *data_file, StudentRecord *student)
+{
+    if (memtable)
+        return memtable_insert(index_file, data_file, student);
+    return insert_student(index_file, data_file, student);
+}
+
+// Busca primeiro na memtable (chaves ainda não fundidas) e depois na árvore
+void lookup_student(FILE *data_file, FILE *index_file, char *key)
+{
+    StudentRecord student;
+    if (memtable_find(key, &student))
+    {
+        printf("Chave %s encontrada na memtable\n", key);
+        printf("ID: %s, Disciplina: %s, Nome: %s, Média: %.2f, Frequência: %.2f\n",
+               student.id, student.discipline, student.name, student.grade, student.attendance);
+        count_operations(index_file, 0, 1);
+        return;
+    }
+    search_student(data_file, index_file, key);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+// Grava no disco o que foi escrito em file (não basta o fflush: os dados podem estar
+// só na cache do sistema operacional); retorna 0 se falhou
+int sync_file(FILE *file)
+{
+    if (fflush(file) != 0)
+        return 0;
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+// Copia para new_index as páginas alcançáveis a partir de rrn (filhos antes do pai)
+// e retorna o novo endereço da página; *ok passa a 0 se alguma gravação falhar
+long long vacuum_page(long long rrn, FILE *new_index, long long *next_rrn, int *ok)
+{
+    if (rrn == NIL || !*ok)
+        return NIL;
+
+    BTreePage page;
+    read_page(rrn, &page);
+    for (int i = 0; i <= page.keycount; i++)
+        page.children[i] = vacuum_page(page.children[i], new_index, next_rrn, ok);
+
+    long long new_rrn = (*next_rrn)++;
+    if (!write_page_to(new_index, new_rrn, &page))
+        *ok = 0;
+    return new_rrn;
+}
+
+// Recolhe as versões antigas de páginas deixadas pela cópia-na-escrita: monta um índice
+// só com as páginas da raiz atual e troca os arquivos por rename. Snapshots antigos
+// deixam de existir, então só deve rodar sem leitores usando raízes anteriores.
+// Se o arquivo novo não puder ser gravado por inteiro (disco cheio), ele é apagado e o
+// índice atual continua em uso.
+void vacuum_index(FILE **index_file)
+{
+    FILE *new_index = fopen(VACUUM_FILENAME, "wb");
+    if (!new_index)
+    {
+        perror("Erro ao criar o arquivo do vacuum");
+        return;
+    }
+
+    Header header = read_header(*index_file);
+    long long old_pages = getpage();
+    long long next_rrn = 0;
+    int ok = 1;
+    header.root_rrn = vacuum_page(header.root_rrn, new_index, &next_rrn, &ok);
+    if (ok && !write_header_to(new_index, &header))
+        ok = 0;
+    if (ok && !sync_file(new_index))
+        ok = 0;
+    if (fclose(new_index) != 0)
+        ok = 0;
+    if (!ok)
+    {
+        perror("Erro ao gravar o arquivo do vacuum");
+        remove(VACUUM_FILENAME);
+        printf("Vacuum cancelado: o indice atual foi mantido\n");
+        return;
+    }
+    close_index_file(*index_file);
+
+#ifdef _WIN32
+    remove(INDEX_FILENAME);
+#endif
+    if (rename(VACUUM_FILENAME, INDEX_FILENAME) != 0)
+    {
+        perror("Erro ao substituir o arquivo de índice");
+        exit(1);
+    }
+
+    *index_file = fopen(INDEX_FILENAME, "rb+");
+    if (!*index_file)
+    {
+        perror("Erro ao reabrir o arquivo de índice");
+        exit(1);
+    }
+    if (btfd)
+        btfd = *index_file;
+    printf("Vacuum do indice: %lld -> %lld paginas\n", old_pages, next_rrn);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+// Migra o index.bin para o formato atual. O arquivo de dados não muda de formato, então o
+// índice é reconstruído lendo registros.bin do início ao fim; os contadores do cabeçalho
+// antigo (versionado ou do formato original) são mantidos.
+void migrate_index()
+{
+    int insert_count = 0, search_count = 0;
+    FILE *old_index = fopen(INDEX_FILENAME, "rb");
+    if (old_index)
+    {
+        Header old_header;
+        LegacyHeader legacy;
+        if (fread(&old_header, sizeof(Header), 1, old_index) == 1 && old_header.magic == INDEX_MAGIC)
+        {
+            insert_count = old_header.insert_count;
+            search_count = old_header.search_count;
+        }
+        else
+        {
+            fseeko(old_index, 0, SEEK_SET);
+            if (fread(&legacy, sizeof(LegacyHeader), 1, old_index) == 1)
+            {
+                insert_count = legacy.insert_count;
+                search_count = legacy.search_count;
+            }
+        }
+        fclose(old_index);
+    }
+
+    FILE *data_file = fopen(FILENAME, "rb");
+    FILE *new_index = fopen(MIGRATE_FILENAME, "wb+");
+    if (!data_file || !new_index)
+    {
+        perror("Erro ao abrir os arquivos da migração");
+        exit(1);
+    }
+    init_header(new_index);
+    btfd = new_index;
+
+    StudentRecord student;
+    long long record_rrn = 0;
+    long long count = 0;
+    while (read_student(data_file, &student))
+    {
+        char key[7], promo_key[7];
+        long long promo_child, promo_rrn, promo_count;
+        KeyFields fields = {student.grade, student.attendance}, promo_fields;
+        sprintf(key, "%s%s", student.id, student.discipline);
+
+        long long root = read_header(new_index).root_rrn;
+        int promoted = insert_in_tree(root, key, record_rrn, fields, &promo_child, promo_key, &promo_rrn, &promo_fields, &promo_count);
+        if (promoted == 1)
+            create_root(promo_key, promo_rrn, promo_fields, root, promo_child);
+        if (promoted != -1)
+            count++;
+        record_rrn = ftello(data_file);
+    }
+
+    Header header = read_header(new_index);
+    header.insert_count = insert_count;
+    header.search_count = search_count;
+    update_header(new_index, &header);
+    close_index_file(new_index);
+    fclose(data_file);
+    btfd = NULL;
+
+#ifdef _WIN32
+    remove(INDEX_FILENAME);
+#endif
+    if (rename(MIGRATE_FILENAME, INDEX_FILENAME) != 0)
+    {
+        perror("Erro ao substituir o arquivo de índice");
+        exit(1);
+    }
+
+    // O arquivo colunar e o índice por média guardam endereços no formato antigo;
+    // são refeitos na próxima execução
+    remove(COLUMN_FILENAME);
+    remove(GRADE_INDEX_FILENAME);
+    printf("Indice migrado para a versao %d: %lld chaves\n", INDEX_VERSION, count);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+// Copia um registro do arquivo de dados antigo para o fim do novo e retorna o novo endereço
+// (o registro é decodificado e regravado, então registros antigos passam a usar o dicionário)
+long long copy_record(FILE *data_file, FILE *new_file, long long record_rrn)
+{
+    StudentRecord student;
+    fseeko(data_file, record_rrn, SEEK_SET);
+    read_student(data_file, &student);
+
+    long long new_rrn = ftello(new_file);
+    write_student(new_file, &student);
+    return new_rrn;
+}
+
+// Percorre a árvore em ordem, copiando os registros vivos para o novo arquivo de dados
+// e gravando as páginas com os novos endereços no índice temporário
+void compact_page(FILE *data_file, FILE *new_file, FILE *new_index, long long rrn)
+{
+    if (rrn == NIL)
+        return;
+
+    BTreePage page;
+    read_page(rrn, &page);
+
+    for (int i = 0; i < page.keycount; i++)
+    {
+        compact_page(data_file, new_file, new_index, page.children[i]);
+        page.record_rrn[i] = copy_record(data_file, new_file, page.record_rrn[i]);
+    }
+    compact_page(data_file, new_file, new_index, page.children[page.keycount]);
+
+    write_page_to(new_index, rrn, &page);
+}
+
+// Grava no disco as entradas do diretório atual (criações, renomeações e remoções)
+void sync_directory()
+{
+#ifndef _WIN32
+    int dir = open(".", O_RDONLY);
+    if (dir >= 0)
+    {
+        fsync(dir);
+        close(dir);
+    }
+#endif
+}
+
+// Troca um arquivo pelo temporário; no Windows o rename não sobrescreve o destino
+int replace_file(const char *temp_filename, const char *filename)
+{
+#ifdef _WIN32
+    remove(filename);
+#endif
+    return rename(temp_filename, filename);
+}
+
+// Conclui a troca de arquivos de uma compactação. Com COMPACT_JOURNAL presente a troca
+// já foi confirmada: os temporários que ainda existirem são renomeados, o arquivo colunar
+// e o índice por média (endereços antigos) são apagados para serem refeitos, e só então
+// a marca é removida. Sem a marca, a compactação não chegou a ser confirmada e os
+// temporários são descartados; registros.bin e index.bin continuam os antigos.
+// Chamada na inicialização e ao fim de cada compactação; retorna 1 se havia troca a concluir.
+int finish_compaction()
+{
+    FILE *journal = fopen(COMPACT_JOURNAL, "rb");
+    if (!journal)
+    {
+        remove(COMPACT_FILENAME);
+        remove(COMPACT_INDEX_FILENAME);
+        return 0;
+    }
+    fclose(journal);
+
+    FILE *pending = fopen(COMPACT_FILENAME, "rb");
+    if (pending)
+    {
+        fclose(pending);
+        if (replace_file(COMPACT_FILENAME, FILENAME) != 0)
+        {
+            perror("Erro ao substituir o arquivo de dados compactado");
+            exit(1);
+        }
+    }
+    pending = fopen(COMPACT_INDEX_FILENAME, "rb");
+    if (pending)
+    {
+        fclose(pending);
+        if (replace_file(COMPACT_INDEX_FILENAME, INDEX_FILENAME) != 0)
+        {
+            perror("Erro ao substituir o índice compactado");
+            exit(1);
+        }
+    }
+    sync_directory();
+
+    remove(COLUMN_FILENAME);
+    remove(GRADE_INDEX_FILENAME);
+    remove(COMPACT_JOURNAL);
+    sync_directory();
+    return 1;
+}
+
+// Compacta o arquivo de dados: só os registros alcançáveis pelo índice são mantidos,
+// em ordem de chave. Os arquivos novos são montados à parte e gravados no disco; a troca
+// é confirmada criando COMPACT_JOURNAL e feita por finish_compaction. Uma interrupção
+// antes da marca deixa os arquivos antigos; depois dela, a inicialização seguinte
+// termina a troca, então registros.bin e index.bin nunca ficam de gerações diferentes.
+// Os arquivos abertos são fechados e reabertos.
+void compact_data_file(FILE **data_file, FILE **index_file)
+{
+    FILE *new_file = fopen(COMPACT_FILENAME, "wb");
+    FILE *new_index = fopen(COMPACT_INDEX_FILENAME, "wb");
+    if (!new_file || !new_index)
+    {
+        perror("Erro ao criar os arquivos da compactação");
+        exit(1);
+    }
+
+    // O índice novo parte de uma cópia do atual; só o record_rrn das páginas muda
+    char buffer[4096];
+    size_t n;
+    flush_header(*index_file);
+    fflush(*index_file);
+    fseeko(*index_file, 0, SEEK_SET);
+    while ((n = fread(buffer, 1, sizeof(buffer), *index_file)) > 0)
+        fwrite(buffer, 1, n, new_index);
+
+    Header header = read_header(*index_file);
+    fseeko(*data_file, 0, SEEK_END);
+    long long old_size = ftello(*data_file);
+
+    compact_page(*data_file, new_file, new_index, header.root_rrn);
+
+    long long new_size = ftello(new_file);
+    sync_file(new_file);
+    sync_file(new_index);
+    fclose(new_file);
+    fclose(new_index);
+    fclose(*data_file);
+    close_index_file(*index_file);
+
+    // Ponto de confirmação: os dois arquivos novos já estão no disco
+    FILE *journal = fopen(COMPACT_JOURNAL, "wb");
+    if (!journal)
+    {
+        perror("Erro ao criar a marca da compactação");
+        exit(1);
+    }
+    fprintf(journal, "%s %s\n", COMPACT_FILENAME, COMPACT_INDEX_FILENAME);
+    sync_file(journal);
+    fclose(journal);
+    sync_directory();
+
+    // O arquivo colunar e o índice por média são fechados para finish_compaction apagá-los
+    int columns = colfd != NULL, grades = gradefd != NULL;
+    if (columns)
+        fclose(colfd);
+    if (grades)
+        fclose(gradefd);
+    finish_compaction();
+
+    *data_file = fopen(FILENAME, "rb+");
+    *index_file = fopen(INDEX_FILENAME, "rb+");
+    if (btfd)
+        btfd = *index_file;
+
+    // Os endereços mudaram: o arquivo colunar e o índice por média são refeitos
+    colfd = columns ? fopen(COLUMN_FILENAME, "wb+") : NULL;
+    gradefd = grades ? fopen(GRADE_INDEX_FILENAME, "wb+") : NULL;
+    column_rebuild(*data_file);
+    grade_rebuild(*data_file, read_header(*index_file).root_rrn);
+    printf("Arquivo de dados compactado: %lld -> %lld bytes\n", old_size, new_size);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+// Analisador da árvore: forma, ocupação e invariantes do index.bin. Em uma primeira
+// etapa, threads leem faixas de páginas sequencialmente (cada uma com seu arquivo) e
+// conferem o que depende só da página: checksum, keycount, ordem das chaves e filhos
+// completos; de cada página fica só um byte com os problemas encontrados. A segunda etapa
+// percorre a árvore a partir da raiz, relendo as páginas alcançáveis, e confere o que liga
+// páginas: endereços, páginas alcançadas mais de uma vez, limites das chaves vindos dos
+// pais e contagens por filho. A memória usada é de um byte e um bit por página (bem
+// menos que o índice) mais um caminho da raiz até uma folha.
+
+#define MAX_LEVELS 32      // Altura máxima considerada pelo analisador
+#define ANALYZE_CHUNK 1024 // Páginas por leitura no analisador
+
+// Problemas de uma página encontrados na primeira etapa
+#define PAGE_CHECKSUM 1 // Checksum não confere (o resto da página não é conferido)
+#define PAGE_KEYCOUNT 2 // keycount fora do intervalo (idem)
+#define PAGE_ORDER 4    // Chaves da página fora de ordem
+#define PAGE_CHILDREN 8 // Filhos incompletos (só parte dos ponteiros preenchida)
+#define PAGE_UNREAD 16  // Página não lida: arquivo truncado ou erro de leitura
+
+typedef struct
+{
+    int height;                            // Altura da árvore (0 se vazia)
+    long long pages_per_level[MAX_LEVELS]; // Páginas alcançáveis em cada nível
+    long long reachable;                   // Páginas alcançáveis a partir da raiz
+    long long distance_sum;                // Soma de |rrn do filho - rrn do pai|
+    long long links;                       // Número de ligações pai-filho
+    long long errors;                      // Invariantes violados
+    long long fill[MAX_KEYS + 1];          // Páginas alcançáveis com cada número de chaves
+} TreeShape;
+
+// Lê as páginas [first, last) com um arquivo próprio, anotando os problemas de cada uma.
+// As páginas que não puderem ser lidas ficam com PAGE_UNREAD (o valor inicial)
+void analyze_page_range(long long first, long long last, unsigned char *problems)
+{
+    FILE *index_file = fopen(INDEX_FILENAME, "rb");
+    if (!index_file)
+    {
+        perror("Erro ao abrir o arquivo de índice no analisador");
+        return;
+    }
+    std::vector<BTreePage> pages(ANALYZE_CHUNK);
+
+    fseeko(index_file, sizeof(Header) + first * sizeof(BTreePage), SEEK_SET);
+    for (long long rrn = first; rrn < last;)
+    {
+        size_t wanted = last - rrn < ANALYZE_CHUNK ? (size_t)(last - rrn) : ANALYZE_CHUNK;
+        size_t count = fread(&pages[0], sizeof(BTreePage), wanted, index_file);
+        for (size_t j = 0; j < count; j++)
+        {
+            BTreePage *page = &pages[j];
+            unsigned char found = 0;
+
+            if (page->checksum != page_checksum(page))
+                found = PAGE_CHECKSUM;
+            else if (page->keycount < 1 || page->keycount > MAX_KEYS)
+                found = PAGE_KEYCOUNT;
+            else
+            {
+                for (int i = 1; i < page->keycount; i++)
+                    if (strcmp(page->keys[i - 1], page->keys[i]) >= 0)
+                        found |= PAGE_ORDER;
+
+                // Uma página é folha se não tem filhos; nesse caso nenhum ponteiro pode estar preenchido
+                int leaf = page->children[0] == NIL;
+                for (int i = 0; i <= page->keycount; i++)
+                    if ((page->children[i] == NIL) != leaf)
+                        found |= PAGE_CHILDREN;
+            }
+            problems[rrn + j] = found;
+        }
+        rrn += count;
+        if (count < wanted)
+            break;
+    }
+    fclose(index_file);
+}
+
+// Percorre a subárvore em rrn, conferindo que as chaves estão dentro de (lo, hi) e que a
+// contagem guardada para cada filho confere; retorna o número de chaves da subárvore
+long long analyze_page(FILE *index_file, long long rrn, int level, const char *lo, const char *hi,
+                       const unsigned char *problems, std::vector<bool> &reached, long long total_pages, TreeShape *shape)
+{
+    if (rrn < 0 || rrn >= total_pages)
+    {
+        printf("Pagina %lld: endereco invalido\n", rrn);
+        shape->errors++;
+        return 0;
+    }
+    if (reached[rrn])
+    {
+        printf("Pagina %lld: alcancada mais de uma vez\n", rrn);
+        shape->errors++;
+        return 0;
+    }
+    reached[rrn] = true;
+    shape->reachable++;
+    if (level < MAX_LEVELS)
+        shape->pages_per_level[level]++;
+    if (level + 1 > shape->height)
+        shape->height = level + 1;
+
+    BTreePage page;
+    int flags = problems[rrn];
+    if (!(flags & PAGE_UNREAD) && !read_page_from(index_file, rrn, &page))
+        flags |= PAGE_CHECKSUM; // Mudou desde a primeira etapa ou a releitura falhou
+    if (flags & PAGE_UNREAD)
+    {
+        printf("Pagina %lld: nao foi lida (arquivo truncado ou erro de leitura)\n", rrn);
+        shape->errors++;
+        return 0;
+    }
+    if (flags & PAGE_CHECKSUM)
+    {
+        printf("Pagina %lld: checksum nao confere\n", rrn);
+        shape->errors++;
+        return 0;
+    }
+    if (flags & PAGE_KEYCOUNT)
+    {
+        printf("Pagina %lld: keycount %d invalido\n", rrn, page.keycount);
+        shape->errors++;
+        return 0;
+    }
+    shape->fill[page.keycount]++;
+    if (flags & PAGE_ORDER)
+    {
+        printf("Pagina %lld: chaves fora de ordem\n", rrn);
+        shape->errors++;
+    }
+
+    // Com as chaves da página em ordem, basta conferir a primeira e a última contra os limites
+    if ((lo && strcmp(page.keys[0], lo) <= 0) || (hi && strcmp(page.keys[page.keycount - 1], hi) >= 0))
+    {
+        printf("Pagina %lld: chave fora do intervalo (%s, %s) do pai\n", rrn, lo ? lo : "-", hi ? hi : "-");
+        shape->errors++;
+    }
+
+    if (flags & PAGE_CHILDREN)
+    {
+        printf("Pagina %lld: filhos incompletos\n", rrn);
+        shape->errors++;
+        return page.keycount;
+    }
+
+    int leaf = page.children[0] == NIL;
+    long long count = page.keycount;
+    for (int i = 0; i <= page.keycount; i++)
+    {
+        long long child_keys = 0;
+        if (!leaf)
+        {
+            shape->distance_sum += llabs(page.children[i] - rrn);
+            shape->links++;
+            child_keys = analyze_page(index_file, page.children[i], level + 1,
+                                      i > 0 ? page.keys[i - 1] : lo,
+                                      i < page.keycount ? page.keys[i] : hi,
+                                      problems, reached, total_pages, shape);
+        }
+        if (page.child_count[i] != child_keys)
+        {
+            printf("Pagina %lld: contagem do filho %d e %lld, subarvore tem %lld chaves\n", rrn, i, page.child_count[i], child_keys);
+            shape->errors++;
+        }
+        count += child_keys;
+    }
+    return count;
+}
+
+// Mostra altura, páginas por nível, distribuição de ocupação, páginas órfãs,
+// distância média entre pai e filho e os invariantes violados
+void analyze_tree(FILE *index_file)
+{
+    Header header = read_header(index_file);
+    long long total_pages = getpage();
+    std::vector<unsigned char> problems(total_pages > 0 ? total_pages : 1, PAGE_UNREAD);
+    std::vector<bool> reached(total_pages > 0 ? total_pages : 1, false);
+    TreeShape shape;
+    memset(&shape, 0, sizeof(TreeShape));
+
+    // Primeira etapa: leitura sequencial, dividida em faixas de páginas, uma por thread
+    flush_header(index_file);
+    fflush(index_file);
+    int threads_count = std::thread::hardware_concurrency();
+    if (threads_count < 1)
+        threads_count = 1;
+    if (threads_count > total_pages)
+        threads_count = total_pages > 0 ? (int)total_pages : 1;
+
+    std::vector<std::thread> threads;
+    long long per_thread = (total_pages + threads_count - 1) / threads_count;
+    for (int t = 0; t < threads_count; t++)
+    {
+        long long first = t * per_thread < total_pages ? t * per_thread : total_pages;
+        long long last = first + per_thread < total_pages ? first + per_thread : total_pages;
+        threads.push_back(std::thread(analyze_page_range, first, last, &problems[0]));
+    }
+    for (int t = 0; t < threads_count; t++)
+        threads[t].join();
+
+    // Segunda etapa: percurso a partir da raiz, relendo as páginas alcançáveis
+    if (header.root_rrn != NIL)
+    {
+        FILE *walk_file = fopen(INDEX_FILENAME, "rb");
+        if (!walk_file)
+        {
+            perror("Erro ao abrir o arquivo de índice no analisador");
+            return;
+        }
+        analyze_page(walk_file, header.root_rrn, 0, NULL, NULL, &problems[0], reached, total_pages, &shape);
+        fclose(walk_file);
+    }
+
+    // Páginas órfãs não lidas também contam: o arquivo está truncado ou ilegível
+    long long orphans = 0, unread = 0;
+    for (long long rrn = 0; rrn < total_pages; rrn++)
+    {
+        if (problems[rrn] & PAGE_UNREAD)
+            unread++;
+        if (!reached[rrn])
+        {
+            orphans++;
+            if (problems[rrn] & PAGE_UNREAD)
+                shape.errors++;
+        }
+    }
+
+    printf("Raiz: %lld, Altura: %d, Paginas: %lld (alcancaveis: %lld, orfas: %lld)\n",
+           header.root_rrn, shape.height, total_pages, shape.reachable, orphans);
+    for (int level = 0; level < shape.height && level < MAX_LEVELS; level++)
+        printf("Nivel %d: %lld paginas\n", level, shape.pages_per_level[level]);
+
+    long long keys = 0;
+    for (int k = 0; k <= MAX_KEYS; k++)
+    {
+        printf("Paginas com %d chaves: %lld\n", k, shape.fill[k]);
+        keys += k * shape.fill[k];
+    }
+    if (shape.reachable > 0)
+        printf("Ocupacao media: %.1f%%\n", 100.0 * keys / ((double)shape.reachable * MAX_KEYS));
+    if (shape.links > 0)
+        printf("Distancia media pai-filho: %.1f paginas\n", (double)shape.distance_sum / shape.links);
+    if (unread > 0)
+        printf("Paginas nao lidas (arquivo truncado ou erro de leitura): %lld\n", unread);
+    printf("Invariantes violados: %lld\n", shape.errors);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+// Verificação do index.bin: confere o checksum do cabeçalho e de todas as páginas, lendo
+// o arquivo sequencialmente em blocos, dividido em faixas de páginas (uma por thread),
+// e lista só as páginas danificadas. O tempo é o de ler o arquivo uma vez.
+
+#define VERIFY_CHUNK 1024 // Páginas por leitura na verificação
+
+// Confere as páginas [first, last) com um arquivo próprio, anotando as danificadas
+void verify_page_range(const char *index_filename, long long first, long long last, std::vector<long long> *damaged)
+{
+    FILE *index_file = fopen(index_filename, "rb");
+    std::vector<BTreePage> pages(VERIFY_CHUNK);
+
+    fseeko(index_file, sizeof(Header) + first * sizeof(BTreePage), SEEK_SET);
+    for (long long rrn = first; rrn < last;)
+    {
+        size_t wanted = last - rrn < VERIFY_CHUNK ? (size_t)(last - rrn) : VERIFY_CHUNK;
+        size_t count = fread(&pages[0], sizeof(BTreePage), wanted, index_file);
+        for (size_t i = 0; i < count; i++)
+            if (pages[i].checksum != page_checksum(&pages[i]))
+                damaged->push_back(rrn + i);
+        rrn += count;
+        if (count < wanted)
+            break;
+    }
+    fclose(index_file);
+}
+
+// Verifica o arquivo de índice; retorna o número de danos encontrados (cabeçalho e páginas)
+long long verify_index(const char *index_filename)
+{
+    FILE *index_file = fopen(index_filename, "rb");
+    if (!index_file)
+    {
+        printf("Arquivo %s nao existe; nada a verificar\n", index_filename);
+        return 0;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    long long problems = 0;
+    Header header;
+    if (fread(&header, sizeof(Header), 1, index_file) != 1 || header.magic != INDEX_MAGIC ||
+        header.version != INDEX_VERSION || header.checksum != header_checksum(&header))
+    {
+        printf("Cabecalho danificado ou de formato antigo\n");
+        problems++;
+    }
+    fseeko(index_file, 0, SEEK_END);
+    long long size = ftello(index_file);
+    fclose(index_file);
+
+    long long total_pages = size > (long long)sizeof(Header) ? (size - sizeof(Header)) / sizeof(BTreePage) : 0;
+    long long tail = size > (long long)sizeof(Header) ? (size - sizeof(Header)) % sizeof(BTreePage) : 0;
+
+    int threads_count = std::thread::hardware_concurrency();
+    if (threads_count < 1)
+        threads_count = 1;
+    if (threads_count > total_pages)
+        threads_count = total_pages > 0 ? (int)total_pages : 1;
+
+    std::vector<std::vector<long long>> damaged(threads_count);
+    std::vector<std::thread> threads;
+    long long per_thread = (total_pages + threads_count - 1) / threads_count;
+    for (int t = 0; t < threads_count; t++)
+    {
+        long long first = t * per_thread;
+        long long last = first + per_thread < total_pages ? first + per_thread : total_pages;
+        threads.push_back(std::thread(verify_page_range, index_filename, first, last < first ? first : last, &damaged[t]));
+    }
+
+    // As faixas estão em ordem, então as páginas saem em ordem de RRN
+    for (int t = 0; t < threads_count; t++)
+    {
+        threads[t].join();
+        for (size_t i = 0; i < damaged[t].size(); i++)
+            printf("Pagina %lld danificada\n", damaged[t][i]);
+        problems += damaged[t].size();
+    }
+    if (tail > 0)
+    {
+        printf("Pagina %lld incompleta (%lld bytes)\n", total_pages, tail);
+        problems++;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("Verificacao de %s: %lld paginas, %lld danos, %.3f s (%.0f MB/s, %d threads)\n", index_filename,
+           total_pages, problems, seconds, seconds > 0 ? size / seconds / 1e6 : 0.0, threads_count);
+    return problems;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+// Modo servidor: o programa fica no ar com o índice e o arquivo de dados abertos e atende
+// requisições binárias em sequência. O cliente pode enviar várias requisições sem esperar
+// as respostas; elas são respondidas na ordem em que chegaram.
+// Os dois caminhos podem ser FIFOs (mkfifo) ou arquivos comuns.
+
+#define REQ_SEARCH 'S' // Busca por chave
+#define REQ_RANGE 'R'  // Busca por intervalo de chaves [key, key_hi]
+#define REQ_INSERT 'I' // Inserção de um registro
+#define REQ_FIELDS 'G'       // Média e frequência de uma chave, só pelo índice
+#define REQ_FIELDS_RANGE 'Q' // Média e frequência das chaves em [key, key_hi], só pelo índice
+
+#define RESP_OK 'O'        // Registro encontrado/inserido (intervalo: um por registro)
+#define RESP_NOT_FOUND 'N' // Chave não encontrada
+#define RESP_DUPLICATE 'D' // Inserção recusada por chave duplicada
+#define RESP_END 'E'       // Fim das respostas de um intervalo
+#define RESP_INVALID 'X'   // Operação desconhecida
+
+// Requisição enviada pelo cliente
+typedef struct
+{
+    char op;               // REQ_*
+    char key[7];           // Chave buscada ou limite inferior do intervalo
+    char key_hi[7];        // Limite superior do intervalo
+    StudentRecord student; // Registro a inserir
+} Request;
+
+// Resposta enviada pelo servidor
+typedef struct
+{
+    char status;           // RESP_*
+    StudentRecord student; // Registro encontrado/inserido (REQ_FIELDS*: só id, disciplina, média e frequência)
+} Response;
+
+// Envia uma resposta ao cliente
+void send_response(FILE *out, char status, StudentRecord *student)
+{
+    Response response;
+    memset(&response, 0, sizeof(Response));
+    response.status = status;
+    if (student)
+        response.student = *student;
+    fwrite(&response, sizeof(Response), 1, out);
+}
+
+// Monta uma resposta só com o que o índice guarda: chave, média e frequência
+void fields_to_student(char *key, KeyFields *fields, StudentRecord *student)
+{
+    memset(student, 0, sizeof(StudentRecord));
+    memcpy(student->id, key, 3);
+    memcpy(student->discipline, key + 3, 3);
+    student->grade = fields->grade;
+    student->attendance = fields->attendance;
+}
+
+// Envia, em ordem, os registros com chave no intervalo [lo, hi]
+// (covering: só com os campos do índice, sem ler o arquivo de dados)
+void range_students(FILE *data_file, long long rrn, char *lo, char *hi, int covering, FILE *out)
+{
+    if (rrn == NIL)
+        return;
+
+    BTreePage page;
+    read_page(rrn, &page);
+
+    for (int i = 0; i < page.keycount; i++)
+    {
+        if (strcmp(lo, page.keys[i]) < 0)
+            range_students(data_file, page.children[i], lo, hi, covering, out);
+
+        if (strcmp(page.keys[i], hi) > 0)
+            return; // As chaves seguintes também estão fora do intervalo
+
+        if (strcmp(page.keys[i], lo) >= 0)
+        {
+            StudentRecord student;
+            memset(&student, 0, sizeof(StudentRecord));
+            if (covering)
+                fields_to_student(page.keys[i], &page.fields[i], &student);
+            else
+            {
+                fseeko(data_file, page.record_rrn[i], SEEK_SET);
+                read_student(data_file, &student);
+            }
+            send_response(out, RESP_OK, &student);
+        }
+    }
+    range_students(data_file, page.children[page.keycount], lo, hi, covering, out);
+}
+
+// Atende requisições de in_filename até o fim do arquivo, respondendo em out_filename
+void serve_requests(FILE *index_file, FILE *data_file, const char *in_filename, const char *out_filename)
+{
+    FILE *in = fopen(in_filename, "rb");
+    FILE *out = fopen(out_filename, "wb");
+    if (!in || !out)
+    {
+        perror("Erro ao abrir os arquivos do servidor");
+        exit(1);
+    }
+
+    Request request;
+    int served = 0;
+    while (fread(&request, sizeof(Request), 1, in) == 1)
+    {
+        request.key[6] = '\0';
+        request.key_hi[6] = '\0';
+
+        switch (request.op)
+        {
+        case REQ_SEARCH:
+        {
+            Header header = read_header(index_file);
+            long long page_rrn, record_rrn;
+            int pos;
+            StudentRecord pending;
+            if (memtable_find(request.key, &pending))
+                send_response(out, RESP_OK, &pending);
+            else if (search_in_tree(header.root_rrn, request.key, &page_rrn, &pos, &record_rrn))
+            {
+                StudentRecord student;
+                memset(&student, 0, sizeof(StudentRecord));
+                fseeko(data_file, record_rrn, SEEK_SET);
+                read_student(data_file, &student);
+                send_response(out, RESP_OK, &student);
+            }
+            else
+                send_response(out, RESP_NOT_FOUND, NULL);
+            break;
+        }
+        case REQ_RANGE:
+        case REQ_FIELDS_RANGE:
+        {
+            memtable_flush(index_file, data_file); // O intervalo é lido da árvore
+            Header header = read_header(index_file);
+            range_students(data_file, header.root_rrn, request.key, request.key_hi, request.op == REQ_FIELDS_RANGE, out);
+            send_response(out, RESP_END, NULL);
+            break;
+        }
+        case REQ_FIELDS:
+        {
+            KeyFields fields;
+            StudentRecord pending;
+            int found = memtable_find(request.key, &pending);
+            if (found)
+            {
+                fields.grade = pending.grade;
+                fields.attendance = pending.attendance;
+            }
+            else
+                found = search_key_fields(read_header(index_file).root_rrn, request.key, &fields);
+            if (found)
+            {
+                StudentRecord student;
+                fields_to_student(request.key, &fields, &student);
+                send_response(out, RESP_OK, &student);
+            }
+            else
+                send_response(out, RESP_NOT_FOUND, NULL);
+            break;
+        }
+        case REQ_INSERT:
+            if (ingest_student(index_file, data_file, &request.student))
+                send_response(out, RESP_OK, &request.student);
+            else
+                send_response(out, RESP_DUPLICATE, NULL);
+            break;
+        default:
+            send_response(out, RESP_INVALID, NULL);
+        }
+
+        // Entrega a resposta já; o cliente pode estar esperando por ela
+        fflush(out);
+        served++;
+    }
+
+    fclose(in);
+    fclose(out);
+    printf("Servidor encerrado: %d requisicoes atendidas.\n", served);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+// Cliente do modo servidor: escreve requisições no caminho de entrada do servidor e lê
+// as respostas do caminho de saída. Com FIFOs, o servidor precisa estar no ar; os dois
+// lados abrem os caminhos na mesma ordem (requisições, depois respostas).
+
+typedef struct
+{
+    FILE *requests;  // Caminho de requisições (entrada do servidor)
+    FILE *responses; // Caminho de respostas (saída do servidor)
+} ServerClient;
+
+// Conecta ao servidor; retorna 0 se algum dos caminhos não abriu
+int client_open(ServerClient *client, const char *in_filename, const char *out_filename)
+{
+    client->requests = fopen(in_filename, "wb");
+    client->responses = client->requests ? fopen(out_filename, "rb") : NULL;
+    if (!client->requests || !client->responses)
+    {
+        perror("Erro ao conectar ao servidor");
+        if (client->requests)
+            fclose(client->requests);
+        return 0;
+    }
+    return 1;
+}
+
+// Fecha o caminho de requisições (o servidor vê o fim e encerra) e o de respostas
+void client_close(ServerClient *client)
+{
+    fclose(client->requests);
+    fclose(client->responses);
+}
+
+// Envia uma requisição (key_hi e student podem ser NULL)
+void client_send(ServerClient *client, char op, const char *key, const char *key_hi, StudentRecord *student)
+{
+    Request request;
+    memset(&request, 0, sizeof(Request));
+    request.op = op;
+    if (key)
+        memcpy(request.key, key, strnlen(key, 6)); // O resto já está zerado
+    if (key_hi)
+        memcpy(request.key_hi, key_hi, strnlen(key_hi, 6));
+    if (student)
+        request.student = *student;
+    fwrite(&request, sizeof(Request), 1, client->requests);
+    fflush(client->requests);
+}
+
+// Lê a próxima resposta; retorna 0 se o servidor fechou o caminho
+int client_receive(ServerClient *client, Response *response)
+{
+    return fread(response, sizeof(Response), 1, client->responses) == 1;
+}
+
+// Busca uma chave; retorna o status da resposta (RESP_OK, RESP_NOT_FOUND) ou 0 sem resposta
+char client_search(ServerClient *client, const char *key, StudentRecord *student)
+{
+    Response response;
+    client_send(client, REQ_SEARCH, key, NULL, NULL);
+    if (!client_receive(client, &response))
+        return 0;
+    if (student)
+        *student = response.student;
+    return response.status;
+}
+
+// Chaves em [lo, hi] pelas respostas de um REQ_FIELDS_RANGE (sem ler o arquivo de dados)
+std::vector<std::string> client_keys(ServerClient *client, const char *lo, const char *hi)
+{
+    std::vector<std::string> keys;
+    Response response;
+    client_send(client, REQ_FIELDS_RANGE, lo, hi, NULL);
+    while (client_receive(client, &response) && response.status == RESP_OK)
+        keys.push_back(std::string(response.student.id, 3) + std::string(response.student.discipline, 3));
+    return keys;
+}
+
+#define LOAD_QUERIES 100000 // Buscas do gerador de carga, se nada for configurado
+
+// Percentil p (0 a 100) de latências já ordenadas
+double latency_percentile(const std::vector<double> &sorted, double p)
+{
+    size_t i = (size_t)(p / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[i];
+}
+
+// Gerador de carga: busca chaves sorteadas (as existentes, lidas do servidor, e algumas
+// ausentes) uma de cada vez, esperando cada resposta, e mostra a distribuição da
+// latência por busca (percentis e histograma em faixas de potências de 2 µs)
+void run_load(const char *in_filename, const char *out_filename, int queries)
+{
+    ServerClient client;
+    if (!client_open(&client, in_filename, out_filename))
+        exit(1);
+
+    std::vector<std::string> keys = client_keys(&client, "000000", "999999");
+    printf("Gerador de carga: %zu chaves no servidor, %d buscas\n", keys.size(), queries);
+
+    std::vector<double> latencies;
+    latencies.reserve(queries);
+    srand(42);
+    int found = 0;
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < queries; i++)
+    {
+        char key[7];
+        if (!keys.empty() && rand() % 10 != 0) // 90% de chaves existentes
+            strcpy(key, keys[rand() % keys.size()].c_str());
+        else
+            sprintf(key, "%03u%03u", (unsigned)rand() % 1000, (unsigned)rand() % 1000);
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        char status = client_search(&client, key, NULL);
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        if (!status)
+        {
+            printf("Servidor encerrou a conexao apos %d buscas\n", i);
+            break;
+        }
+        found += status == RESP_OK;
+        latencies.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    client_close(&client);
+    if (latencies.empty())
+        return;
+
+    std::vector<double> sorted = latencies;
+    std::sort(sorted.begin(), sorted.end());
+    printf("%zu buscas (%d encontradas) em %.3f s: %.0f buscas/s\n", sorted.size(), found, seconds, sorted.size() / seconds);
+    printf("Latencia (us): min %.1f, p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n",
+           sorted[0], latency_percentile(sorted, 50), latency_percentile(sorted, 90),
+           latency_percentile(sorted, 99), latency_percentile(sorted, 99.9), sorted.back());
+
+    // Histograma: faixa k conta as latências em [2^(k-1), 2^k) µs (faixa 0: abaixo de 1 µs)
+    long long histogram[32] = {0};
+    for (size_t i = 0; i < sorted.size(); i++)
+    {
+        int bucket = 0;
+        while (bucket < 31 && sorted[i] >= (double)(1LL << bucket))
+            bucket++;
+        histogram[bucket]++;
+    }
+    for (int bucket = 0; bucket < 32; bucket++)
+        if (histogram[bucket] > 0)
+            printf("  < %8lld us: %8lld (%5.1f%%)\n", 1LL << bucket, histogram[bucket], 100.0 * histogram[bucket] / sorted.size());
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+// Importação de arquivos no formato do insere.bin maiores que a memória, em três etapas
+// encadeadas: uma thread lê blocos do arquivo; threads de trabalho ordenam cada bloco
+// e o gravam como uma sequência ordenada (run) em arquivo temporário; por fim a
+// intercalação das runs insere os registros em ordem de chave no arquivo de dados e
+// no índice. A memória usada é limitada a (threads + fila) blocos de run_size registros.
+// A intercalação abre no máximo import_fan_in() runs de uma vez; com mais runs que isso,
+// passadas intermediárias juntam grupos de runs em runs maiores até sobrarem poucas.
+
+#define IMPORT_RUN_SIZE 65536  // Registros por bloco, se nada for configurado
+#define IMPORT_QUEUE 2         // Blocos lidos esperando uma thread de trabalho
+#define IMPORT_MAX_FAN_IN 256  // Runs intercaladas de uma vez, no máximo
+#define IMPORT_RESERVED_FDS 16 // Descritores deixados para os demais arquivos abertos
+
+typedef struct
+{
+    StudentRecord *records; // Registros do bloco (NULL marca o fim da leitura)
+    int count;              // Registros usados
+} ImportChunk;
+
+// Fila limitada entre a thread de leitura e as de ordenação
+typedef struct
+{
+    ImportChunk chunks[IMPORT_QUEUE];
+    int head, size;
+    std::mutex lock;
+    std::condition_variable not_empty, not_full;
+    int runs;   // Runs criadas até agora
+    int failed; // 1: uma run não pôde ser gravada (a leitura para)
+} ImportQueue;
+
+// Nome do arquivo temporário da run
+void run_filename(char *filename, int run)
+{
+    sprintf(filename, "run_%d.tmp", run);
+}
+
+// Apaga os arquivos das runs [first, last)
+void remove_runs(int first, int last)
+{
+    char filename[32];
+    for (int run = first; run < last; run++)
+    {
+        run_filename(filename, run);
+        remove(filename);
     }
-    temp_children[MAX_KEYS] = p_oldpage->children[MAX_KEYS];
+}
 
-    // Insere a nova chave no lugar apropriado
-    int i;
-    for (i = MAX_KEYS; i > 0 && strcmp(key, temp_keys[i - 1]) < 0; i--)
+// Quantas runs podem ficar abertas ao mesmo tempo: limitado por IMPORT_MAX_FAN_IN e
+// pelo limite de arquivos abertos do processo (menos os reservados para o resto)
+int import_fan_in()
+{
+    long long limit = IMPORT_MAX_FAN_IN;
+#ifdef _WIN32
+    limit = _getmaxstdio();
+#else
+    struct rlimit files;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur != RLIM_INFINITY)
+        limit = (long long)files.rlim_cur;
+#endif
+    limit -= IMPORT_RESERVED_FDS;
+    if (limit > IMPORT_MAX_FAN_IN)
+        limit = IMPORT_MAX_FAN_IN;
+    return limit < 2 ? 2 : (int)limit;
+}
+
+// Compara registros pela chave ("ID+Disciplina")
+int compare_student_key(const void *a, const void *b)
+{
+    const StudentRecord *sa = (const StudentRecord *)a;
+    const StudentRecord *sb = (const StudentRecord *)b;
+    int cmp = strncmp(sa->id, sb->id, 3);
+    return cmp ? cmp : strncmp(sa->discipline, sb->discipline, 3);
+}
+
+void import_queue_push(ImportQueue *queue, ImportChunk chunk)
+{
+    std::unique_lock<std::mutex> guard(queue->lock);
+    queue->not_full.wait(guard, [queue] { return queue->size < IMPORT_QUEUE; });
+    queue->chunks[(queue->head + queue->size) % IMPORT_QUEUE] = chunk;
+    queue->size++;
+    queue->not_empty.notify_one();
+}
+
+ImportChunk import_queue_pop(ImportQueue *queue)
+{
+    std::unique_lock<std::mutex> guard(queue->lock);
+    queue->not_empty.wait(guard, [queue] { return queue->size > 0; });
+    ImportChunk chunk = queue->chunks[queue->head];
+    if (chunk.records == NULL)
+        return chunk; // A marca de fim fica na fila para as outras threads
+    queue->head = (queue->head + 1) % IMPORT_QUEUE;
+    queue->size--;
+    queue->not_full.notify_one();
+    return chunk;
+}
+
+// Etapa 1: lê o arquivo de entrada em blocos de run_size registros
+void import_reader(FILE *input, int run_size, ImportQueue *queue)
+{
+    while (1)
     {
-        strcpy(temp_keys[i], temp_keys[i - 1]);
-        temp_children[i + 1] = temp_children[i];
-        temp_rrns[i] = temp_rrns[i - 1];
+        {
+            std::lock_guard<std::mutex> guard(queue->lock);
+            if (queue->failed)
+                break;
+        }
+        ImportChunk chunk;
+        chunk.records = (StudentRecord *)malloc(run_size * sizeof(StudentRecord));
+        if (!chunk.records)
+        {
+            printf("Memoria insuficiente para um bloco de %d registros\n", run_size);
+            std::lock_guard<std::mutex> guard(queue->lock);
+            queue->failed = 1;
+            break;
+        }
+        chunk.count = fread(chunk.records, sizeof(StudentRecord), run_size, input);
+        if (chunk.count == 0)
+        {
+            free(chunk.records);
+            break;
+        }
+        import_queue_push(queue, chunk);
     }
-    strcpy(temp_keys[i], key);
-    temp_children[i + 1] = r_child;
-    temp_rrns[i] = rrn;
 
-    init_page(p_newpage);
-    *promo_r_child = getpage();
-    *promo_rrn = temp_rrns[mid];
-    strcpy(promo_key, temp_keys[mid]);
-    printf("Chave %s promovida\n", promo_key);
+    ImportChunk end = {NULL, 0};
+    import_queue_push(queue, end);
+}
 
-    // Divide os elementos na página antiga e na nova
-    for (int j = 0; j < mid; j++)
+// Etapa 2: ordena cada bloco e o grava como run_<n>.tmp
+void import_sorter(ImportQueue *queue)
+{
+    while (1)
     {
-        strcpy(p_oldpage->keys[j], temp_keys[j]);
-        p_oldpage->children[j] = temp_children[j];
-        p_oldpage->record_rrn[j] = temp_rrns[j];
+        ImportChunk chunk = import_queue_pop(queue);
+        if (chunk.records == NULL)
+            return;
+
+        qsort(chunk.records, chunk.count, sizeof(StudentRecord), compare_student_key);
+
+        int run;
+        {
+            std::lock_guard<std::mutex> guard(queue->lock);
+            run = queue->runs++;
+        }
+        char filename[32];
+        run_filename(filename, run);
+        FILE *run_file = fopen(filename, "wb");
+        int written = run_file && fwrite(chunk.records, sizeof(StudentRecord), chunk.count, run_file) == (size_t)chunk.count;
+        if (run_file && fclose(run_file) != 0)
+            written = 0;
+        free(chunk.records);
+        if (!written)
+        {
+            // Continua esvaziando a fila, para a leitura não ficar bloqueada
+            perror("Erro ao gravar arquivo de run");
+            std::lock_guard<std::mutex> guard(queue->lock);
+            queue->failed = 1;
+        }
     }
-    p_oldpage->children[mid] = temp_children[mid];
-    p_oldpage->keycount = mid;
+}
+
+// Run aberta durante a intercalação, com o próximo registro dela
+typedef struct
+{
+    StudentRecord head; // Menor registro ainda não consumido da run
+    int run;            // Número da run (desempate: a de menor número sai primeiro)
+    FILE *file;
+} MergeSource;
+
+// Ordem do heap da intercalação: o topo é o menor registro
+struct MergeSourceGreater
+{
+    bool operator()(const MergeSource &a, const MergeSource &b) const
+    {
+        int cmp = compare_student_key(&a.head, &b.head);
+        return cmp ? cmp > 0 : a.run > b.run;
+    }
+};
+
+// Intercala as runs [first, last) com um heap (O(log k) por registro). Com out, grava
+// o resultado como uma run nova; sem out, insere cada registro no índice e no arquivo
+// de dados, somando em *inserted. As runs lidas são apagadas no fim.
+// Retorna 0 se alguma run não pôde ser aberta ou a run nova não pôde ser gravada.
+int merge_runs(int first, int last, FILE *out, FILE *index_file, FILE *data_file, long long *inserted)
+{
+    std::priority_queue<MergeSource, std::vector<MergeSource>, MergeSourceGreater> heap;
+    std::vector<FILE *> files;
+    char filename[32];
+    int ok = 1;
+
+    for (int run = first; run < last && ok; run++)
+    {
+        run_filename(filename, run);
+        MergeSource source;
+        source.run = run;
+        source.file = fopen(filename, "rb");
+        if (!source.file)
+        {
+            perror("Erro ao abrir arquivo de run");
+            ok = 0;
+            break;
+        }
+        files.push_back(source.file);
+        if (fread(&source.head, sizeof(StudentRecord), 1, source.file) == 1)
+            heap.push(source);
+    }
+
+    while (ok && !heap.empty())
+    {
+        MergeSource source = heap.top();
+        heap.pop();
+        if (out)
+            ok = fwrite(&source.head, sizeof(StudentRecord), 1, out) == 1;
+        else
+            *inserted += insert_student(index_file, data_file, &source.head);
+        if (fread(&source.head, sizeof(StudentRecord), 1, source.file) == 1)
+            heap.push(source);
+    }
+
+    for (size_t i = 0; i < files.size(); i++)
+        fclose(files[i]);
+    if (ok)
+        remove_runs(first, last);
+    return ok;
+}
+
+// Importa input_filename: ordena por runs em paralelo e intercala as runs inserindo
+// cada registro em ordem de chave. Retorna o número de alunos inseridos.
+int import_students(FILE *index_file, FILE *data_file, const char *input_filename, int run_size)
+{
+    FILE *input = fopen(input_filename, "rb");
+    if (!input)
+    {
+        perror("Erro ao abrir o arquivo de importação");
+        return 0;
+    }
+
+    int workers = std::thread::hardware_concurrency();
+    if (workers < 2)
+        workers = 2;
+    workers--; // Um núcleo fica com a leitura
+
+    ImportQueue queue;
+    queue.head = queue.size = queue.runs = queue.failed = 0;
+
+    std::thread reader(import_reader, input, run_size, &queue);
+    std::vector<std::thread> sorters;
+    for (int i = 0; i < workers; i++)
+        sorters.push_back(std::thread(import_sorter, &queue));
+    reader.join();
+    for (int i = 0; i < workers; i++)
+        sorters[i].join();
+    fclose(input);
+
+    int runs = queue.runs;
+    if (queue.failed)
+    {
+        remove_runs(0, runs);
+        printf("Importacao cancelada: runs temporarias apagadas\n");
+        return 0;
+    }
+
+    // Etapa 3: cada passada intermediária junta grupos de fan_in runs consecutivas do
+    // nível atual em runs novas (numeradas a partir de runs), até o nível ter no máximo
+    // fan_in runs. A numeração segue a ordem da entrada, então chaves repetidas saem na
+    // mesma ordem que numa intercalação de uma passada só.
+    int fan_in = import_fan_in();
+    int first = 0, passes = 0;
+    char filename[32];
+    while (runs - first > fan_in)
+    {
+        int level_end = runs;
+        for (int group = first; group < level_end; group += fan_in)
+        {
+            int last = group + fan_in < level_end ? group + fan_in : level_end;
+            run_filename(filename, runs);
+            FILE *out = fopen(filename, "wb");
+            int ok = out != NULL;
+            if (!out)
+                perror("Erro ao criar arquivo de run");
+            else
+            {
+                ok = merge_runs(group, last, out, NULL, NULL, NULL);
+                if (fclose(out) != 0)
+                    ok = 0;
+            }
+            if (!ok)
+            {
+                remove_runs(group, runs + 1);
+                printf("Importacao cancelada: runs temporarias apagadas\n");
+                return 0;
+            }
+            runs++;
+        }
+        first = level_end;
+        passes++;
+    }
+
+    // Última passada: intercala as runs restantes inserindo em ordem de chave
+    long long inserted = 0;
+    if (!merge_runs(first, runs, NULL, index_file, data_file, &inserted))
+    {
+        remove_runs(first, runs);
+        printf("Importacao interrompida apos %lld alunos inseridos: runs temporarias apagadas\n", inserted);
+        return (int)inserted;
+    }
+    printf("Importacao: %lld alunos inseridos a partir de %d runs (%d passadas intermediarias, ate %d runs por vez)\n",
+           inserted, queue.runs, passes, fan_in);
+    return (int)inserted;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+// Cursor para percorrer uma árvore em ordem de chave, uma chave por vez
+typedef struct
+{
+    FILE *index_file;             // Índice percorrido
+    int depth;                    // Topo da pilha (-1: cursor esgotado)
+    int pos[MAX_LEVELS];          // Próxima chave a visitar em cada página da pilha
+    BTreePage pages[MAX_LEVELS];  // Caminho da raiz até a página atual
+} TreeCursor;
+
+// Empilha rrn e desce pelo filho mais à esquerda até a folha
+void cursor_descend(TreeCursor *cursor, long long rrn)
+{
+    while (rrn != NIL && cursor->depth + 1 < MAX_LEVELS)
+    {
+        cursor->depth++;
+        if (!read_page_from(cursor->index_file, rrn, &cursor->pages[cursor->depth]))
+            damaged_page(rrn);
+        cursor->pos[cursor->depth] = 0;
+        rrn = cursor->pages[cursor->depth].children[0];
+    }
+}
+
+// Posiciona o cursor na menor chave da árvore com raiz root
+void cursor_init(TreeCursor *cursor, FILE *index_file, long long root)
+{
+    cursor->index_file = index_file;
+    cursor->depth = -1;
+    cursor_descend(cursor, root);
+}
+
+// Devolve a próxima chave em ordem; retorna 0 quando a árvore acabou
+int cursor_next(TreeCursor *cursor, char *key, long long *record_rrn)
+{
+    while (cursor->depth >= 0)
+    {
+        BTreePage *page = &cursor->pages[cursor->depth];
+        int pos = cursor->pos[cursor->depth];
+        if (pos < page->keycount)
+        {
+            strcpy(key, page->keys[pos]);
+            *record_rrn = page->record_rrn[pos];
+            cursor->pos[cursor->depth]++;
+            cursor_descend(cursor, page->children[pos + 1]);
+            return 1;
+        }
+        cursor->depth--;
+    }
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+// Modo particionado: as chaves são distribuídas por hash do ID do aluno entre N pares
+// independentes de índice/dados (index_<n>.bin e registros_<n>.bin), cada um com seu
+// cabeçalho. Inserções e buscas em lote rodam uma thread por shard; a listagem
+// combina os cursores dos shards em ordem de chave.
+
+#define MAX_SHARDS 16
+
+typedef struct
+{
+    int count;                      // Número de shards
+    FILE *index_files[MAX_SHARDS];  // Índice de cada shard
+    FILE *data_files[MAX_SHARDS];   // Arquivo de dados de cada shard
+} ShardSet;
+
+// Shard de uma chave: hash FNV-1a do ID do aluno (todas as matrículas de um aluno
+// ficam no mesmo shard)
+int shard_of(const char *key, int count)
+{
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < 3; i++)
+        hash = (hash ^ (unsigned char)key[i]) * 16777619u;
+    return hash % count;
+}
+
+// Abre (criando se preciso) os arquivos dos shards
+void open_shards(ShardSet *shards, int count)
+{
+    char filename[32];
+    shards->count = count;
+    for (int s = 0; s < count; s++)
+    {
+        sprintf(filename, "index_%d.bin", s);
+        initialize_btree(filename);
+        shards->index_files[s] = fopen(filename, "rb+");
+
+        sprintf(filename, "registros_%d.bin", s);
+        shards->data_files[s] = fopen(filename, "rb+");
+        if (!shards->data_files[s])
+            shards->data_files[s] = fopen(filename, "wb+");
+    }
+}
+
+void close_shards(ShardSet *shards)
+{
+    for (int s = 0; s < shards->count; s++)
+    {
+        close_index_file(shards->index_files[s]);
+        fclose(shards->data_files[s]);
+    }
+}
+
+// Insere, na thread do shard, os alunos do lote que pertencem a ele
+void shard_insert_worker(ShardSet *shards, int shard, StudentRecord *students, int count, int *inserted)
+{
+    btfd = shards->index_files[shard];
+    for (int i = 0; i < count; i++)
+    {
+        char key[7];
+        sprintf(key, "%s%s", students[i].id, students[i].discipline);
+        if (shard_of(key, shards->count) == shard)
+            *inserted += insert_student(shards->index_files[shard], shards->data_files[shard], &students[i]);
+    }
+}
+
+// Insere um lote de alunos, com uma thread por shard
+int shard_insert_students(ShardSet *shards, StudentRecord *students, int count)
+{
+    std::vector<std::thread> threads;
+    std::vector<int> inserted(shards->count, 0);
+    for (int s = 0; s < shards->count; s++)
+        threads.push_back(std::thread(shard_insert_worker, shards, s, students, count, &inserted[s]));
+
+    int total = 0;
+    for (int s = 0; s < shards->count; s++)
+    {
+        threads[s].join();
+        total += inserted[s];
+    }
+    return total;
+}
+
+// Importa um arquivo no formato do insere.bin para os shards, chunk registros por vez:
+// cada bloco lido é separado por shard, cada parte é ordenada por chave e as partes são
+// inseridas em paralelo, uma thread por shard. Retorna o número de alunos inseridos.
+long long shard_import(ShardSet *shards, const char *input_filename, int chunk)
+{
+    FILE *input = fopen(input_filename, "rb");
+    if (!input)
+    {
+        perror("Erro ao abrir o arquivo de importação");
+        return 0;
+    }
+
+    std::vector<StudentRecord> block(chunk);
+    std::vector<std::vector<StudentRecord>> parts(shards->count);
+    long long read = 0, inserted = 0;
+    int count;
+    while ((count = fread(&block[0], sizeof(StudentRecord), chunk, input)) > 0)
+    {
+        for (int s = 0; s < shards->count; s++)
+            parts[s].clear();
+        for (int i = 0; i < count; i++)
+        {
+            char key[7];
+            sprintf(key, "%.3s%.3s", block[i].id, block[i].discipline);
+            parts[shard_of(key, shards->count)].push_back(block[i]);
+        }
+
+        std::vector<std::thread> threads;
+        std::vector<int> part_inserted(shards->count, 0);
+        for (int s = 0; s < shards->count; s++)
+        {
+            if (!parts[s].empty())
+                qsort(&parts[s][0], parts[s].size(), sizeof(StudentRecord), compare_student_key);
+            threads.push_back(std::thread(shard_insert_worker, shards, s, parts[s].data(), (int)parts[s].size(), &part_inserted[s]));
+        }
+        for (int s = 0; s < shards->count; s++)
+        {
+            threads[s].join();
+            inserted += part_inserted[s];
+        }
+        read += count;
+    }
+    fclose(input);
+    printf("Importacao particionada: %lld registros lidos, %lld alunos inseridos em %d shards\n", read, inserted, shards->count);
+    return inserted;
+}
+
+// Busca, na thread do shard, as chaves do lote que pertencem a ele
+void shard_search_worker(ShardSet *shards, int shard, char (*keys)[7], int count, int *found, StudentRecord *results)
+{
+    btfd = shards->index_files[shard];
+    Header header = read_header(shards->index_files[shard]);
+    for (int i = 0; i < count; i++)
+    {
+        if (shard_of(keys[i], shards->count) != shard)
+            continue;
+
+        long long page_rrn, record_rrn;
+        int pos;
+        found[i] = search_in_tree(header.root_rrn, keys[i], &page_rrn, &pos, &record_rrn);
+        if (found[i])
+        {
+            fseeko(shards->data_files[shard], record_rrn, SEEK_SET);
+            read_student(shards->data_files[shard], &results[i]);
+        }
+    }
+}
+
+// Busca um lote de chaves, com uma thread por shard; found[i] e results[i] seguem keys[i]
+void shard_search_students(ShardSet *shards, char (*keys)[7], int count, int *found, StudentRecord *results)
+{
+    std::vector<std::thread> threads;
+    for (int s = 0; s < shards->count; s++)
+        threads.push_back(std::thread(shard_search_worker, shards, s, keys, count, found, results));
+    for (int s = 0; s < shards->count; s++)
+        threads[s].join();
+}
+
+// Lista todos os alunos em ordem de chave, combinando um cursor por shard
+void shard_list_all(ShardSet *shards)
+{
+    static TreeCursor cursors[MAX_SHARDS];
+    char keys[MAX_SHARDS][7];
+    long long rrns[MAX_SHARDS];
+    int alive[MAX_SHARDS];
+
+    for (int s = 0; s < shards->count; s++)
+    {
+        Header header = read_header(shards->index_files[s]);
+        cursor_init(&cursors[s], shards->index_files[s], header.root_rrn);
+        alive[s] = cursor_next(&cursors[s], keys[s], &rrns[s]);
+    }
+
+    while (1)
+    {
+        int min = -1;
+        for (int s = 0; s < shards->count; s++)
+            if (alive[s] && (min < 0 || strcmp(keys[s], keys[min]) < 0))
+                min = s;
+        if (min < 0)
+            break;
+
+        StudentRecord student;
+        fseeko(shards->data_files[min], rrns[min], SEEK_SET);
+        read_student(shards->data_files[min], &student);
+        printf("ID: %s, Disciplina: %s, Nome: %s, Média: %.2f, Frequência: %.2f\n",
+               student.id, student.discipline, student.name, student.grade, student.attendance);
+
+        alive[min] = cursor_next(&cursors[min], keys[min], &rrns[min]);
+    }
+}
+
+// Menu do modo particionado: opera em lote sobre insere.bin e busca.bin. Com
+// import_filename, só importa o arquivo para os shards e termina.
+void run_sharded(int shard_count, const char *import_filename, int run_size)
+{
+    ShardSet shards;
+    open_shards(&shards, shard_count);
+
+    if (import_filename)
+    {
+        shard_import(&shards, import_filename, run_size);
+        close_shards(&shards);
+        return;
+    }
+
+    char option = 'a';
+    while (option != '0')
+    {
+        printf("\nModo particionado (%d shards):\n", shard_count);
+        printf("1. Inserir todos os alunos (em paralelo)\n");
+        printf("2. Buscar todas as chaves (em paralelo)\n");
+        printf("3. Listar todos os alunos\n");
+        printf("0. Sair\n");
+        printf("Opcao: ");
+        if (scanf(" %c", &option) != 1)
+            break;
+
+        switch (option)
+        {
+        case '0':
+            break;
+        case '1':
+        {
+            int inserted = shard_insert_students(&shards, vet, MAX_INSERE);
+            printf("%d alunos inseridos\n", inserted);
+            break;
+        }
+        case '2':
+        {
+            char keys[MAX_BUSCA][7];
+            int found[MAX_BUSCA] = {0};
+            StudentRecord results[MAX_BUSCA];
+            for (int i = 0; i < MAX_BUSCA; i++)
+            {
+                memcpy(keys[i], vet_b[i].id_aluno, 3);
+                memcpy(keys[i] + 3, vet_b[i].sigla_disc, 3);
+                keys[i][6] = '\0';
+            }
+
+            shard_search_students(&shards, keys, MAX_BUSCA, found, results);
+            for (int i = 0; i < MAX_BUSCA; i++)
+            {
+                if (found[i])
+                    printf("ID: %s, Disciplina: %s, Nome: %s, Média: %.2f, Frequência: %.2f\n",
+                           results[i].id, results[i].discipline, results[i].name, results[i].grade, results[i].attendance);
+                else
+                    printf("Chave %s não encontrada\n", keys[i]);
+            }
+            break;
+        }
+        case '3':
+            shard_list_all(&shards);
+            break;
+        default:
+            printf("Opcao invalida! Tente novamente.\n");
+        }
+    }
+
+    close_shards(&shards);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+// Índice por hash extensível, alternativa à árvore-B só para buscas exatas por chave.
+// Um diretório de 2^global_depth entradas (mantido em memória e gravado em hash_dir.bin)
+// aponta para buckets de tamanho fixo em hash_buckets.bin; vários diretórios podem
+// apontar para o mesmo bucket enquanto a profundidade local dele for menor que a global.
+// Um bucket cheio é dividido em dois pelo próximo bit do hash, dobrando o diretório
+// quando preciso. Uma busca lê um único bucket, qualquer que seja o número de chaves.
+// Não há ordem entre as chaves: listagens e intervalos continuam sendo da árvore-B.
+// O hash_dir.bin começa com identificação e versão; um diretório da versão 1 (só a
+// profundidade global) é convertido na abertura, e um arquivo irreconhecível, um
+// diretório que aponta para fora de hash_buckets.bin ou um bucket ilegível encerram o
+// programa em vez de serem usados.
+
+#define HASH_DIR_FILENAME "hash_dir.bin"         // Diretório do hash extensível
+#define HASH_BUCKET_FILENAME "hash_buckets.bin"  // Buckets do hash extensível
+#define HASH_DATA_FILENAME "registros_hash.bin"  // Arquivo de dados do modo hash
+#define BUCKET_SIZE 8        // Entradas por bucket
+#define MAX_GLOBAL_DEPTH 24  // Diretório de no máximo 16M entradas
+#define HASH_MAGIC 0x48544241 // "ABTH": identifica o hash_dir.bin
+#define HASH_VERSION 2        // 1: só a profundidade global; 2: identificação e versão
+
+typedef struct
+{
+    int local_depth;                // Bits do hash que todas as chaves do bucket têm em comum
+    int count;                      // Entradas usadas
+    char keys[BUCKET_SIZE][7];      // Chaves ("ID+Disciplina")
+    long long record_rrn[BUCKET_SIZE]; // Endereço do registro no arquivo de dados
+} HashBucket;
+
+// Cabeçalho do hash_dir.bin, seguido das entradas do diretório
+typedef struct
+{
+    int magic;        // HASH_MAGIC
+    int version;      // HASH_VERSION
+    int global_depth; // Bits do hash usados pelo diretório
+} HashDirHeader;
+
+typedef struct
+{
+    FILE *dir_file;                   // Cabeçalho seguido das entradas do diretório
+    FILE *bucket_file;                // Buckets
+    int global_depth;                 // Bits do hash usados pelo diretório
+    std::vector<long long> directory; // Bucket de cada entrada (2^global_depth entradas)
+} HashIndex;
+
+// Hash FNV-1a da chave inteira
+unsigned int hash_key(const char *key)
+{
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < 6; i++)
+        hash = (hash ^ (unsigned char)key[i]) * 16777619u;
+    return hash;
+}
 
-    for (int j = mid + 1; j <= MAX_KEYS; j++)
+// Lê o bucket rrn. Um bucket fora do arquivo ou com campos impossíveis encerra o
+// programa, em vez de ser tratado como um bucket de verdade.
+void read_bucket(HashIndex *hash, long long rrn, HashBucket *bucket)
+{
+    fseeko(hash->bucket_file, rrn * sizeof(HashBucket), SEEK_SET);
+    if (fread(bucket, sizeof(HashBucket), 1, hash->bucket_file) != 1 || bucket->count < 0 ||
+        bucket->count > BUCKET_SIZE || bucket->local_depth < 0 || bucket->local_depth > hash->global_depth)
     {
-        strcpy(p_newpage->keys[j - mid - 1], temp_keys[j]);
-        p_newpage->children[j - mid - 1] = temp_children[j];
-        p_newpage->record_rrn[j - mid - 1] = temp_rrns[j];
+        printf("Bucket %lld do hash ilegivel ou danificado; apague os arquivos do hash para recomecar.\n", rrn);
+        exit(1);
     }
-    p_newpage->children[MAX_KEYS - mid] = temp_children[MAX_CHILD];
-    p_newpage->keycount = MAX_KEYS - mid - 1;
 }
 
-int insert_in_tree(int rrn, char *key, int record_rrn, int *promo_child, char *promo_key, int *promo_rrn)
+void write_bucket(HashIndex *hash, long long rrn, HashBucket *bucket)
 {
-    //BTreePage page;
+    fseeko(hash->bucket_file, rrn * sizeof(HashBucket), SEEK_SET);
+    fwrite(bucket, sizeof(HashBucket), 1, hash->bucket_file);
+}
 
-    BTreePage page, newpage;
-    //Current page / new page if split occurs
-    
-    int p_b_rrn; // rrn promoted from below
-    char p_b_key[7]; //chave promoted from below
+long long new_bucket(HashIndex *hash)
+{
+    fseeko(hash->bucket_file, 0, SEEK_END);
+    return ftello(hash->bucket_file) / (long long)sizeof(HashBucket);
+}
 
-    if (rrn == NIL)
+// Grava as entradas [first, last) do diretório
+void write_directory(HashIndex *hash, long long first, long long last)
+{
+    HashDirHeader header = {HASH_MAGIC, HASH_VERSION, hash->global_depth};
+    fseeko(hash->dir_file, 0, SEEK_SET);
+    fwrite(&header, sizeof(HashDirHeader), 1, hash->dir_file);
+    fseeko(hash->dir_file, sizeof(HashDirHeader) + first * sizeof(long long), SEEK_SET);
+    fwrite(&hash->directory[first], sizeof(long long), last - first, hash->dir_file);
+}
+
+// Carrega as 2^global_depth entradas do diretório a partir de offset e confere se
+// todas apontam para buckets existentes. Retorna 0 se o diretório está incompleto.
+int load_directory(HashIndex *hash, long long offset)
+{
+    fseeko(hash->bucket_file, 0, SEEK_END);
+    long long buckets = ftello(hash->bucket_file) / (long long)sizeof(HashBucket);
+
+    hash->directory.resize(1LL << hash->global_depth);
+    fseeko(hash->dir_file, offset, SEEK_SET);
+    if (fread(&hash->directory[0], sizeof(long long), hash->directory.size(), hash->dir_file) != hash->directory.size())
+        return 0;
+    for (size_t i = 0; i < hash->directory.size(); i++)
+        if (hash->directory[i] < 0 || hash->directory[i] >= buckets)
+            return 0;
+    return 1;
+}
+
+// Abre (criando se preciso, com um bucket vazio) um índice por hash e carrega o diretório
+void hash_open(HashIndex *hash, const char *dir_filename, const char *bucket_filename)
+{
+    hash->dir_file = fopen(dir_filename, "rb+");
+    hash->bucket_file = fopen(bucket_filename, "rb+");
+    HashDirHeader header;
+    if (hash->dir_file && hash->bucket_file && fread(&header, sizeof(int), 1, hash->dir_file) == 1)
     {
-        // Caso base: se o nó é NIL, a chave deve ser promovida ao nível superior
-        strcpy(promo_key, key);
-        *promo_rrn = record_rrn;
-        printf("Record rrn: %d\n", record_rrn);
-        *promo_child = NIL;
-        return 1; // Indica que a promoção ocorreu
+        fseeko(hash->dir_file, 0, SEEK_END);
+        long long size = ftello(hash->dir_file);
+        fseeko(hash->dir_file, 0, SEEK_SET);
+        if (fread(&header, sizeof(HashDirHeader), 1, hash->dir_file) == 1 && header.magic == HASH_MAGIC &&
+            header.version == HASH_VERSION && header.global_depth >= 0 && header.global_depth <= MAX_GLOBAL_DEPTH)
+        {
+            hash->global_depth = header.global_depth;
+            if (load_directory(hash, sizeof(HashDirHeader)))
+                return;
+        }
+        else if (header.magic >= 0 && header.magic <= MAX_GLOBAL_DEPTH &&
+                 size == (long long)sizeof(int) + (long long)sizeof(long long) * (1LL << header.magic))
+        {
+            // Versão 1: a profundidade global e logo depois o diretório (os buckets não mudaram)
+            hash->global_depth = header.magic;
+            if (load_directory(hash, sizeof(int)))
+            {
+                write_directory(hash, 0, hash->directory.size());
+                fflush(hash->dir_file);
+                printf("%s convertido para a versao %d\n", dir_filename, HASH_VERSION);
+                return;
+            }
+        }
+        printf("%s de formato desconhecido ou danificado; apague %s e %s para recomecar.\n", dir_filename,
+               dir_filename, bucket_filename);
+        exit(1);
     }
 
-    //printf("Passou 1\n");
-
-    read_page(rrn, &page);
+    if (hash->dir_file)
+        fclose(hash->dir_file);
+    if (hash->bucket_file)
+        fclose(hash->bucket_file);
+    hash->dir_file = fopen(dir_filename, "wb+");
+    hash->bucket_file = fopen(bucket_filename, "wb+");
+    if (!hash->dir_file || !hash->bucket_file)
+    {
+        perror("Erro ao criar os arquivos do hash");
+        exit(1);
+    }
 
-    //printf("Passou read_page. \n");
+    HashBucket bucket;
+    memset(&bucket, 0, sizeof(HashBucket));
+    write_bucket(hash, 0, &bucket);
+    hash->global_depth = 0;
+    hash->directory.assign(1, 0);
+    write_directory(hash, 0, 1);
+}
 
-    int pos;
-    int found = search_node(key, &page, &pos);
+void hash_close(HashIndex *hash)
+{
+    fclose(hash->dir_file);
+    fclose(hash->bucket_file);
+}
 
-    if (found)
+// Busca key: uma leitura de bucket. Retorna 1 e o endereço do registro se a chave existe.
+int hash_search(HashIndex *hash, char *key, long long *record_rrn)
+{
+    HashBucket bucket;
+    unsigned int h = hash_key(key);
+    read_bucket(hash, hash->directory[h & ((1u << hash->global_depth) - 1)], &bucket);
+    for (int i = 0; i < bucket.count; i++)
     {
-        printf("Chave %s duplicada\n", key);
-        return -1; // Indica falha na inserção por chave duplicada
+        if (strcmp(bucket.keys[i], key) == 0)
+        {
+            *record_rrn = bucket.record_rrn[i];
+            return 1;
+        }
     }
+    return 0;
+}
 
-    //printf("Vai entrar prox insert tree. \n");
+// Insere key; retorna 1 se inseriu, 0 se a chave já existia e -1 se o diretório
+// chegou ao tamanho máximo
+int hash_insert(HashIndex *hash, char *key, long long record_rrn)
+{
+    unsigned int h = hash_key(key);
+    HashBucket bucket;
 
-    // Chamada recursiva para inserir no filho apropriado
-    int promoted = insert_in_tree(page.children[pos], key, record_rrn, promo_child, promo_key, promo_rrn);
+    while (1)
+    {
+        long long entry = h & ((1u << hash->global_depth) - 1);
+        long long rrn = hash->directory[entry];
+        read_bucket(hash, rrn, &bucket);
 
-    //printf("Passou o insert tree. \n");
+        for (int i = 0; i < bucket.count; i++)
+            if (strcmp(bucket.keys[i], key) == 0)
+                return 0;
 
-    if (promoted == -1)
-        return -1; // Retorna imediatamente se houve uma duplicação de chave
-    if (promoted == 0)
-        return 0; // Caso não ocorra promoção, termina a função
+        if (bucket.count < BUCKET_SIZE)
+        {
+            strcpy(bucket.keys[bucket.count], key);
+            bucket.record_rrn[bucket.count++] = record_rrn;
+            write_bucket(hash, rrn, &bucket);
+            return 1;
+        }
 
-    //printf("Passou dos verificadores de promocao e duplicata. \n");
+        // Bucket cheio: se ele já usa todos os bits do diretório, o diretório dobra
+        if (bucket.local_depth == hash->global_depth)
+        {
+            if (hash->global_depth == MAX_GLOBAL_DEPTH)
+            {
+                printf("Diretorio do hash no tamanho maximo\n");
+                return -1;
+            }
+            long long size = hash->directory.size();
+            hash->directory.resize(2 * size);
+            for (long long i = 0; i < size; i++)
+                hash->directory[size + i] = hash->directory[i];
+            hash->global_depth++;
+            write_directory(hash, size, 2 * size);
+        }
 
-    // Se há espaço na página, insere a chave promovida na posição correta
-    if (page.keycount < MAX_KEYS)
-    {
-        //printf("Entrou em page.keycount < MAX_KEYS .\n");
-        insert_in_page(promo_key, *promo_rrn, *promo_child, &page);
-        write_page(rrn, &page);
-        return 0; // Não ocorre promoção adicional
-    }
-    else
-    {
-        // Divisão do nó: ocorre promoção de uma chave para o nível superior
-        printf("Divisao de no\n");
-        //split(promo_key, *promo_rrn, *promo_child, &page, promo_key, promo_rrn, promo_child);
-        split(key, p_b_rrn, rrn, &page, promo_key, promo_child, &newpage, promo_rrn);
+        // Divide o bucket pelo bit local_depth do hash
+        int bit = bucket.local_depth;
+        HashBucket sibling;
+        memset(&sibling, 0, sizeof(HashBucket));
+        sibling.local_depth = bucket.local_depth = bit + 1;
+        int kept = 0;
+        for (int i = 0; i < bucket.count; i++)
+        {
+            if (hash_key(bucket.keys[i]) >> bit & 1)
+            {
+                strcpy(sibling.keys[sibling.count], bucket.keys[i]);
+                sibling.record_rrn[sibling.count++] = bucket.record_rrn[i];
+            }
+            else
+            {
+                strcpy(bucket.keys[kept], bucket.keys[i]);
+                bucket.record_rrn[kept++] = bucket.record_rrn[i];
+            }
+        }
+        bucket.count = kept;
 
-        write_page(rrn, &page);
-        write_page(*promo_child, &newpage);
-        return 1; // Indica que uma promoção adicional ocorreu
+        long long sibling_rrn = new_bucket(hash);
+        write_bucket(hash, rrn, &bucket);
+        write_bucket(hash, sibling_rrn, &sibling);
+
+        // As entradas do bucket antigo com o bit ligado passam para o novo
+        for (long long i = entry & ((1LL << bit) - 1); i < (long long)hash->directory.size(); i += 1LL << bit)
+        {
+            if (i >> bit & 1)
+            {
+                hash->directory[i] = sibling_rrn;
+                write_directory(hash, i, i + 1);
+            }
+        }
     }
 }
 
-void insert_student(FILE *index_file, FILE *data_file, StudentRecord *student)
+// Retorna 1 se o aluno foi inserido, 0 se a chave já existia (mesma interface de insert_student)
+int hash_insert_student(HashIndex *hash, FILE *data_file, StudentRecord *student)
 {
-    Header header = read_header(index_file);
-
     char key[7];
     sprintf(key, "%s%s", student->id, student->discipline);
 
-    int promo_child;
-    char promo_key[7];
-    int promo_rrn;
+    fseeko(data_file, 0, SEEK_END);
+    long long record_rrn = ftello(data_file);
+    int inserted = hash_insert(hash, key, record_rrn);
+    if (inserted != 1)
+    {
+        if (inserted == 0)
+            printf("Chave %s duplicada\n", key);
+        return 0;
+    }
 
-    int root = header.root_rrn;
-    fseek(data_file, 0, SEEK_END);
-    int record_rrn = ftell(data_file) /*/ sizeof(StudentRecord)*/;
+    write_student(data_file, student);
+    fflush(hash->dir_file);
+    fflush(hash->bucket_file);
+    printf("Chave %s inserida com sucesso\n", key);
+    return 1;
+}
 
-    // Primeiro, tentamos inserir na árvore-B
-    int promoted = insert_in_tree(root, key, record_rrn, &promo_child, promo_key, &promo_rrn);
+// Busca e mostra um aluno (mesma interface de search_student)
+void hash_search_student(HashIndex *hash, FILE *data_file, char *key)
+{
+    long long record_rrn;
+    if (hash_search(hash, key, &record_rrn))
+    {
+        StudentRecord student;
+        fseeko(data_file, record_rrn, SEEK_SET);
+        read_student(data_file, &student);
+        printf("ID: %s, Disciplina: %s, Nome: %s, Média: %.2f, Frequência: %.2f\n",
+               student.id, student.discipline, student.name, student.grade, student.attendance);
+    }
+    else
+        printf("Chave %s não encontrada\n", key);
+}
 
-    // Se a chave é duplicada, atualiza o contador e retorna
-    if (promoted == -1)
+// Modo hash: TrabalhoAula8_V2 --hash. Usa arquivos próprios (hash_dir.bin, hash_buckets.bin
+// e registros_hash.bin), pois o index.bin não acompanharia as inserções feitas aqui.
+void run_hashed()
+{
+    HashIndex hash;
+    hash_open(&hash, HASH_DIR_FILENAME, HASH_BUCKET_FILENAME);
+    FILE *data_file = fopen(HASH_DATA_FILENAME, "rb+");
+    if (!data_file)
+        data_file = fopen(HASH_DATA_FILENAME, "wb+");
+
+    char option = 'a';
+    while (option != '0')
     {
-        // printf("Chave %s duplicada\n", key);
-        header.insert_count++; // Atualiza o contador de inserções, mesmo para chaves duplicadas
-        update_header(index_file, &header);
-        return; // Termina a função
+        printf("\nModo hash extensivel (profundidade global %d):\n", hash.global_depth);
+        printf("1. Inserir todos os alunos\n");
+        printf("2. Buscar todas as chaves\n");
+        printf("0. Sair\n");
+        printf("Opcao: ");
+        if (scanf(" %c", &option) != 1)
+            break;
+
+        switch (option)
+        {
+        case '0':
+            break;
+        case '1':
+        {
+            int inserted = 0;
+            for (int i = 0; i < MAX_INSERE; i++)
+                inserted += hash_insert_student(&hash, data_file, &vet[i]);
+            printf("%d alunos inseridos\n", inserted);
+            break;
+        }
+        case '2':
+        {
+            for (int i = 0; i < MAX_BUSCA; i++)
+            {
+                char key[7];
+                memcpy(key, vet_b[i].id_aluno, 3);
+                memcpy(key + 3, vet_b[i].sigla_disc, 3);
+                key[6] = '\0';
+                hash_search_student(&hash, data_file, key);
+            }
+            break;
+        }
+        default:
+            printf("Opcao invalida! Tente novamente.\n");
+        }
     }
 
-    // Se a chave não for duplicada, insere o registro no arquivo de dados
-    
-    write_student(data_file, student);
+    hash_close(&hash);
+    fclose(data_file);
+}
+
+// Compara as buscas exatas da árvore-B (index.bin) e do hash extensível sobre o mesmo
+// registros.bin: monta um hash temporário com os endereços dos registros e mede o tempo
+// médio de busca das chaves existentes e de chaves ausentes nos dois índices.
+void run_benchmark(FILE *index_file, FILE *data_file)
+{
+    HashIndex hash;
+    remove(HASH_DIR_FILENAME ".bench");
+    remove(HASH_BUCKET_FILENAME ".bench");
+    hash_open(&hash, HASH_DIR_FILENAME ".bench", HASH_BUCKET_FILENAME ".bench");
 
-    // Atualiza `promo_rrn` com o endereço do registro no arquivo de dados
-    promo_rrn = record_rrn;
+    std::vector<std::string> keys;
+    StudentRecord student;
+    rewind(data_file);
+    long long record_rrn = 0;
+    while (read_student(data_file, &student))
+    {
+        char key[7];
+        sprintf(key, "%s%s", student.id, student.discipline);
+        if (hash_insert(&hash, key, record_rrn) == 1)
+            keys.push_back(key);
+        record_rrn = ftello(data_file);
+    }
+    if (keys.empty())
+    {
+        printf("Arquivo de dados vazio\n");
+        hash_close(&hash);
+        return;
+    }
 
-    // Atualiza a árvore com o RRN correto do registro
-    if (promoted == 1)
+    long long root = read_header(index_file).root_rrn;
+    for (int missing = 0; missing <= 1; missing++)
     {
-        // Caso a promoção ocorra na raiz, cria uma nova raiz
-        root = create_root(promo_key, promo_rrn, promo_child);
+        long long found_btree = 0, found_hash = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            char key[7];
+            strcpy(key, keys[i].c_str());
+            key[5] = missing ? 'x' : key[5]; // Chaves ausentes: dígito trocado por letra
+            long long page_rrn, rrn;
+            int pos;
+            found_btree += search_in_tree(root, key, &page_rrn, &pos, &rrn);
+        }
+        std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            char key[7];
+            strcpy(key, keys[i].c_str());
+            key[5] = missing ? 'x' : key[5];
+            long long rrn;
+            found_hash += hash_search(&hash, key, &rrn);
+        }
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
 
-        header.root_rrn = root; // Atualiza o RRN da raiz no cabeçalho
+        double btree_ns = std::chrono::duration<double, std::nano>(middle - start).count() / keys.size();
+        double hash_ns = std::chrono::duration<double, std::nano>(end - middle).count() / keys.size();
+        printf("%s: %zu buscas, arvore-B %.0f ns/busca (%lld encontradas), hash %.0f ns/busca (%lld encontradas)\n",
+               missing ? "Chaves ausentes" : "Chaves existentes", keys.size(), btree_ns, found_btree, hash_ns, found_hash);
     }
+    printf("Hash: profundidade global %d, %lld buckets\n", hash.global_depth, new_bucket(&hash));
 
-    printf("Chave %s inserida com sucesso\n", key);
-    header.insert_count++;              // Atualiza o contador de inserções para novas inserções
-    update_header(index_file, &header); // Grava o cabeçalho atualizado no arquivo
+    hash_close(&hash);
+    remove(HASH_DIR_FILENAME ".bench");
+    remove(HASH_BUCKET_FILENAME ".bench");
 }
 
-/////////////////////////////////////////////////////////////////////////////////////////////
-
-int main()
+int main(int argc, char *argv[])
 {
     FILE *index_file, *data_file, *file;
 
+    // Opções de linha de comando
+    const char *serve_in = NULL, *serve_out = NULL;
+    const char *load_in = NULL, *load_out = NULL;
+    int load_queries = LOAD_QUERIES;
+    int shard_count = 0;
+    int migrate = 0;
+    int hashed = 0, benchmark = 0;
+    int verify = 0;
+    const char *import_filename = NULL;
+    int run_size = IMPORT_RUN_SIZE;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--redistribuir") == 0)
+            insert_policy = POLICY_REDISTRIBUTE;
+        else if (strcmp(argv[i], "--cow") == 0)
+            cow_mode = 1;
+        else if (strcmp(argv[i], "--migrar") == 0)
+            migrate = 1;
+        else if (strcmp(argv[i], "--hash") == 0)
+            hashed = 1;
+        else if (strcmp(argv[i], "--benchmark") == 0)
+            benchmark = 1;
+        else if (strcmp(argv[i], "--verificar") == 0)
+            verify = 1;
+        else if (strcmp(argv[i], "--memtable") == 0 && i + 1 < argc)
+        {
+            memtable_capacity = atoi(argv[++i]) > 0 ? atoi(argv[i]) : MEMTABLE_CAPACITY;
+            memtable = new Memtable();
+        }
+        else if (strcmp(argv[i], "--importar") == 0 && i + 1 < argc)
+            import_filename = argv[++i];
+        else if (strcmp(argv[i], "--run") == 0 && i + 1 < argc)
+            run_size = atoi(argv[++i]) > 0 ? atoi(argv[i]) : IMPORT_RUN_SIZE;
+        else if (strcmp(argv[i], "--shards") == 0 && i + 1 < argc)
+        {
+            shard_count = atoi(argv[++i]);
+            if (shard_count < 1 || shard_count > MAX_SHARDS)
+            {
+                printf("Numero de shards deve estar entre 1 e %d\n", MAX_SHARDS);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--servidor") == 0 && i + 2 < argc)
+        {
+            serve_in = argv[++i];
+            serve_out = argv[++i];
+        }
+        else if (strcmp(argv[i], "--carga") == 0 && i + 2 < argc)
+        {
+            load_in = argv[++i];
+            load_out = argv[++i];
+            if (i + 1 < argc && atoi(argv[i + 1]) > 0)
+                load_queries = atoi(argv[++i]);
+        }
+    }
+
+    // Gerador de carga contra um servidor no ar: TrabalhoAula8_V2 --carga <requisicoes> <respostas> [buscas]
+    // (os caminhos são os FIFOs passados ao --servidor; não abre os arquivos locais)
+    if (load_in)
+    {
+        run_load(load_in, load_out, load_queries);
+        return 0;
+    }
+
     // Abre o arquivo binário para leitura
     file = fopen("insere.bin", "rb");
     if (file == NULL)
@@ -691,6 +4848,44 @@ int main()
         printf("\n");
     }*/
 
+    // Carrega o dicionário de disciplinas (usado por todos os modos)
+    load_dictionary();
+
+    // Modo particionado: TrabalhoAula8_V2 --shards <n> [--importar <arquivo> [--run <registros por bloco>]]
+    if (shard_count > 0)
+    {
+        run_sharded(shard_count, import_filename, run_size);
+        printf("Programa encerrado.\n");
+        return 0;
+    }
+
+    // Índice por hash extensível: TrabalhoAula8_V2 --hash
+    if (hashed)
+    {
+        run_hashed();
+        printf("Programa encerrado.\n");
+        return 0;
+    }
+
+    // Termina a troca de arquivos de uma compactação interrompida (ou descarta os temporários)
+    if (finish_compaction())
+        printf("Compactacao interrompida concluida: %s e %s trocados\n", FILENAME, INDEX_FILENAME);
+
+    // Migração do formato do índice: TrabalhoAula8_V2 --migrar
+    if (migrate)
+    {
+        migrate_index();
+        return 0;
+    }
+
+    // Verificação dos checksums antes de abrir o índice: TrabalhoAula8_V2 --verificar
+    // (com danos, o programa para; sem danos, segue normalmente)
+    if (verify && verify_index(INDEX_FILENAME) > 0)
+    {
+        printf("Indice danificado; reconstrua com --migrar.\n");
+        return 1;
+    }
+
     // Inicializa a árvore-B (cria o arquivo de índice se ele não existe)
     initialize_btree(INDEX_FILENAME);
 
@@ -709,6 +4904,64 @@ int main()
         data_file = fopen(FILENAME, "wb+");
     }
 
+    // Mantém o índice aberto durante toda a execução
+    btfd = index_file;
+
+    // Abre (ou cria e preenche a partir do arquivo de dados) o arquivo colunar
+    colfd = fopen(COLUMN_FILENAME, "rb+");
+    if (!colfd)
+    {
+        colfd = fopen(COLUMN_FILENAME, "wb+");
+        column_rebuild(data_file);
+    }
+
+    // Abre (ou cria e preenche a partir do índice principal) o índice por média
+    gradefd = fopen(GRADE_INDEX_FILENAME, "rb+");
+    if (gradefd && !grade_header_valid())
+    {
+        printf("%s de formato antigo ou danificado; refazendo a partir do indice.\n", GRADE_INDEX_FILENAME);
+        grade_rebuild(data_file, read_header(index_file).root_rrn);
+    }
+    if (!gradefd)
+    {
+        gradefd = fopen(GRADE_INDEX_FILENAME, "wb+");
+        grade_rebuild(data_file, read_header(index_file).root_rrn);
+    }
+
+    // Importação: TrabalhoAula8_V2 --importar <arquivo> [--run <registros por bloco>]
+    if (import_filename)
+    {
+        import_students(index_file, data_file, import_filename, run_size);
+        close_index_file(index_file);
+        fclose(data_file);
+        fclose(colfd);
+        fclose(gradefd);
+        return 0;
+    }
+
+    // Comparação de buscas árvore-B x hash: TrabalhoAula8_V2 --benchmark
+    if (benchmark)
+    {
+        run_benchmark(index_file, data_file);
+        close_index_file(index_file);
+        fclose(data_file);
+        fclose(colfd);
+        fclose(gradefd);
+        return 0;
+    }
+
+    // Modo servidor: TrabalhoAula8_V2 --servidor <requisicoes> <respostas>
+    if (serve_in)
+    {
+        serve_requests(index_file, data_file, serve_in, serve_out);
+        memtable_flush(index_file, data_file);
+        close_index_file(index_file);
+        fclose(data_file);
+        fclose(colfd);
+        fclose(gradefd);
+        return 0;
+    }
+
     char option = 'a';
     while (option != '0')
     {
@@ -716,6 +4969,18 @@ int main()
         printf("1. Inserir um aluno\n");
         printf("2. Buscar um aluno\n");
         printf("3. Listar todos os alunos\n");
+        printf("4. Atualizar media e frequencia de um aluno\n");
+        printf("5. Atualizar medias e frequencias em lote (%s)\n", UPDATE_FILENAME);
+        printf("6. Compactar arquivo de dados\n");
+        printf("7. Relatorio de medias por disciplina\n");
+        printf("8. Analisar a arvore-B\n");
+        printf("9. Recolher versoes antigas de paginas (vacuum)\n");
+        printf("m. Listar alunos por faixa de media\n");
+        printf("t. Maiores medias (top-K)\n");
+        printf("p. Listar uma pagina da listagem ordenada\n");
+        printf("c. Contar alunos em um intervalo de chaves\n");
+        printf("k. Aluno em uma posicao da ordem\n");
+        printf("n. Consultar media e frequencia (somente o indice)\n");
         printf("0. Sair\n");
         printf("Opcao: ");
         scanf(" %c", &option);
@@ -723,6 +4988,11 @@ int main()
         // if (option == '0')
         // break;
 
+        // Só inserção e buscas por chave atendem com chaves pendentes na memtable;
+        // as demais operações (e a saída) leem o índice ou o arquivo de dados inteiros
+        if (!strchr("12n", option))
+            memtable_flush(index_file, data_file);
+
         switch (option)
         {
         case '0':
@@ -737,8 +5007,8 @@ int main()
 
             // printf("Inserindo aluno de numero %d.\n", header.insert_count);
 
-            // Insere o aluno no arquivo e na árvore-B
-            insert_student(index_file, data_file, &vet[header.insert_count]);
+            // Insere o aluno no arquivo e na árvore-B (ou na memtable)
+            ingest_student(index_file, data_file, &vet[header.insert_count]);
             break;
         }
         case '2':
@@ -750,11 +5020,11 @@ int main()
             header = read_header(index_file);
 
             char key[7];
-            memcpy(key, &vet_b[header.search_count], 3);
-            memcpy(key + 3, &vet_b[header.search_count], 3);
+            memcpy(key, vet_b[header.search_count].id_aluno, 3);
+            memcpy(key + 3, vet_b[header.search_count].sigla_disc, 3);
             key[6] = '\0';
 
-            search_student(index_file, data_file, key);
+            lookup_student(data_file, index_file, key);
             break;
         }
         case '3':
@@ -764,14 +5034,180 @@ int main()
             list_all_students(data_file, header.root_rrn);
             break;
         }
+        case '4':
+        {
+            // Atualiza média e frequência de um aluno
+            char id[4], discipline[4], key[7];
+            float grade, attendance;
+            printf("ID, disciplina, media e frequencia: ");
+            if (scanf("%3s %3s %f %f", id, discipline, &grade, &attendance) != 4)
+            {
+                printf("Entrada invalida!\n");
+                break;
+            }
+            sprintf(key, "%s%s", id, discipline);
+            update_student(data_file, index_file, key, grade, attendance);
+            break;
+        }
+        case '5':
+        {
+            // Aplica as atualizações do arquivo de lote
+            update_students_from_file(data_file, index_file, UPDATE_FILENAME);
+            break;
+        }
+        case '6':
+        {
+            // Remove do arquivo de dados os registros que o índice não alcança mais
+            compact_data_file(&data_file, &index_file);
+            break;
+        }
+        case '7':
+        {
+            // Relatório de médias a partir do arquivo colunar
+            char discipline[4];
+            float min_attendance;
+            printf("Disciplina (* para todas) e frequencia minima: ");
+            if (scanf("%3s %f", discipline, &min_attendance) != 2)
+            {
+                printf("Entrada invalida!\n");
+                break;
+            }
+
+            int code = discipline[0] == '*' ? -1 : discipline_code(discipline);
+            if (discipline[0] != '*' && code < 0)
+            {
+                printf("Disciplina invalida!\n");
+                break;
+            }
+            ColumnStats stats;
+            column_aggregate(code, min_attendance, &stats);
+            if (stats.count == 0)
+            {
+                printf("Nenhum registro encontrado\n");
+                break;
+            }
+            printf("Registros: %d, Media: %.2f, Minima: %.2f, Maxima: %.2f, Abaixo da frequencia: %d\n",
+                   stats.count, stats.sum / stats.count, stats.min, stats.max, stats.below);
+            break;
+        }
+        case '8':
+        {
+            // Mostra a forma e a ocupação do índice
+            analyze_tree(index_file);
+            break;
+        }
+        case '9':
+        {
+            // Remove do índice as páginas que a raiz atual não alcança
+            vacuum_index(&index_file);
+            break;
+        }
+        case 'm':
+        {
+            // Faixa de médias pelo índice secundário, em ordem crescente ou decrescente
+            float lo, hi;
+            char order, discipline[4];
+            printf("Media minima, maxima, ordem (c/d) e disciplina (* para todas): ");
+            if (scanf("%f %f %c %3s", &lo, &hi, &order, discipline) != 4)
+            {
+                printf("Entrada invalida!\n");
+                break;
+            }
+            int remaining = -1;
+            grade_scan(data_file, grade_root(), lo, hi, order == 'd', discipline[0] == '*' ? NULL : discipline, &remaining);
+            break;
+        }
+        case 't':
+        {
+            // As k maiores médias: percurso decrescente que para no k-ésimo registro
+            int k;
+            char discipline[4];
+            printf("Quantidade e disciplina (* para todas): ");
+            if (scanf("%d %3s", &k, discipline) != 2 || k <= 0)
+            {
+                printf("Entrada invalida!\n");
+                break;
+            }
+            grade_scan(data_file, grade_root(), -1e30f, 1e30f, 1, discipline[0] == '*' ? NULL : discipline, &k);
+            break;
+        }
+        case 'p':
+        {
+            // Uma página da listagem, sem passar pelos registros das páginas anteriores
+            long long page_number, page_size;
+            printf("Numero da pagina (a partir de 1) e registros por pagina: ");
+            if (scanf("%lld %lld", &page_number, &page_size) != 2 || page_number < 1 || page_size < 1)
+            {
+                printf("Entrada invalida!\n");
+                break;
+            }
+            list_students_page(data_file, read_header(index_file).root_rrn, page_number, page_size);
+            break;
+        }
+        case 'c':
+        {
+            // Quantidade de chaves em [lo, hi] e posição de lo na ordem
+            char lo[7], hi[7];
+            printf("Chave inicial e final (ID+Disciplina): ");
+            if (scanf("%6s %6s", lo, hi) != 2)
+            {
+                printf("Entrada invalida!\n");
+                break;
+            }
+            long long root = read_header(index_file).root_rrn;
+            int found;
+            long long rank = rank_key(root, lo, &found);
+            printf("Chaves entre %s e %s: %lld (posicao de %s: %lld)\n", lo, hi, count_keys(root, lo, hi), lo, rank);
+            break;
+        }
+        case 'n':
+        {
+            // Média e frequência guardadas no índice, sem ler o arquivo de dados
+            char id[4], discipline[4], key[7];
+            KeyFields fields;
+            printf("ID e disciplina: ");
+            if (scanf("%3s %3s", id, discipline) != 2)
+            {
+                printf("Entrada invalida!\n");
+                break;
+            }
+            sprintf(key, "%s%s", id, discipline);
+            StudentRecord pending;
+            if (memtable_find(key, &pending))
+                printf("Chave %s (memtable): Média: %.2f, Frequência: %.2f\n", key, pending.grade, pending.attendance);
+            else if (search_key_fields(read_header(index_file).root_rrn, key, &fields))
+                printf("Chave %s: Média: %.2f, Frequência: %.2f\n", key, fields.grade, fields.attendance);
+            else
+                printf("Chave %s não encontrada\n", key);
+            break;
+        }
+        case 'k':
+        {
+            // Aluno na posição i da ordem de chave (0 é o primeiro)
+            long long index, record_rrn;
+            char key[7];
+            printf("Posicao: ");
+            if (scanf("%lld", &index) != 1)
+            {
+                printf("Entrada invalida!\n");
+                break;
+            }
+            if (select_key(read_header(index_file).root_rrn, index, key, &record_rrn))
+                printf("Posicao %lld: chave %s, endereco %lld\n", index, key, record_rrn);
+            else
+                printf("Posicao %lld fora da listagem\n", index);
+            break;
+        }
         default:
             printf("Opcao invalida! Tente novamente.\n");
         }
     }
 
     // Fecha os arquivos antes de sair
-    fclose(index_file);
+    close_index_file(index_file);
     fclose(data_file);
+    fclose(colfd);
+    fclose(gradefd);
 
     printf("Programa encerrado.\n");
     return 0;